@@ -0,0 +1,51 @@
+#pragma once
+
+#include "sim8051/stdafx.hpp"
+
+/// Unusual things the firmware did, which the simulator tolerates (like the real microcontroller), but which usually
+/// are bugs.
+enum class Anomaly : u8 {
+    invalid_sfr, // Direct access to an address from 0x80 which is no SFR.
+    division_by_zero, // DIV AB with B = 0.
+    reserved_instruction, // The op code A5 was executed.
+    count, // Number of kinds.
+};
+
+/// Returns the name of a kind of anomaly (e. g. for JSON keys).
+const char *anomaly_name( Anomaly kind );
+
+/// Occurrences of one kind of anomaly.
+struct AnomalyCounter {
+    u64 count = 0;
+    u16 first_pc = 0; // Address of the instruction which caused the first occurrence.
+    u16 last_pc = 0;
+    u64 first_cycle = 0; // Cycle count when the instruction of the first occurrence started.
+    u64 last_cycle = 0;
+};
+
+/// Counters of all kinds of anomalies since the last full reset. Recording one is a few stores (no formatting or
+/// allocation), so firmware which triggers an anomaly in a tight loop doesn't slow the simulation down.
+struct Anomalies {
+    std::array<AnomalyCounter, static_cast<size_t>( Anomaly::count )> counters;
+
+    /// Counts an occurrence at an instruction.
+    void record( Anomaly kind, u16 pc, u64 cycle ) {
+        auto &counter = counters[static_cast<size_t>( kind )];
+        if ( counter.count++ == 0 ) {
+            counter.first_pc = pc;
+            counter.first_cycle = cycle;
+        }
+        counter.last_pc = pc;
+        counter.last_cycle = cycle;
+    }
+
+    const AnomalyCounter &operator[]( Anomaly kind ) const { return counters[static_cast<size_t>( kind )]; }
+
+    /// Returns the number of occurrences of all kinds.
+    u64 total() const;
+
+    void clear() { counters = {}; }
+
+    /// Writes the counters as a JSON object with one member per kind (indented by "indent" spaces).
+    void write_json( std::ostream &output, size_t indent = 0 ) const;
+};
@@ -0,0 +1,95 @@
+#pragma once
+
+#include "sim8051/stdafx.hpp"
+#include "sim8051/Processor.hpp"
+
+/// Assembler for the syntax described at compile_assembly(). Every line is split into tokens in a single pass, the
+/// mnemonics and names are found with a perfect hash and an instruction is matched by the classes of its operands
+/// (again with a perfect hash), so the time is linear in the size of the source.
+/// The result of every line is kept, so assembling an edited version of the previous source only parses the lines
+/// between the unchanged beginning and end, moves the code behind them and fills in the label references whose label
+/// or position moved.
+class Assembler {
+public:
+    std::vector<u8> code; // Machine code from address 0.
+    /// Range [first, second) of "code" which changed in the last assemble() (empty if nothing changed). It extends
+    /// beyond the code if the code shrunk.
+    std::pair<size_t, size_t> changed;
+
+    /// Assembles source code into "code". Returns false if it contains errors (which are logged).
+    bool assemble( std::string_view new_source );
+    /// Returns the defined labels by address (the first one if several share an address).
+    std::map<u16, String> symbols() const;
+
+private:
+    /// Label reference which is filled in after all lines were assembled.
+    struct Fixup {
+        enum Kind : u8 {
+            relative8, // Offset of a relative jump (the last byte of the instruction).
+            absolute11, // AJMP/ACALL, "pos" is the op code which takes the upper 3 bits.
+            absolute16,
+        };
+        Kind kind;
+        u32 label; // Index into label_targets.
+        size_t pos;
+    };
+
+    /// Result of a source line.
+    struct Line {
+        size_t source_pos; // In "source".
+        size_t source_size;
+        size_t addr; // Of the first byte of its code.
+        size_t fixup_end; // Its fixups end here in "fixups" (and start at the end of the previous line).
+        i32 label; // Label which is defined by the line (or -1).
+        bool clean; // Assembled without messages, so it's only assembled again if it's changed.
+    };
+
+    String source; // Of the last assemble().
+    std::vector<Line> lines;
+    std::unordered_map<String, u32> label_ids;
+    std::vector<i32> label_targets; // Address of every label (-1 if not defined).
+    std::vector<Fixup> fixups;
+    String line; // Normalized current line (lower case, tokens separated by single spaces, no comment).
+    size_t line_no = 0;
+    i32 line_label = -1; // Label defined by the current line.
+    bool line_clean = true; // No messages for the current line.
+    bool successful = true;
+
+    /// Assembles one line of source code (without line break).
+    void assemble_line( std::string_view source_line );
+    /// Assembles the instruction of a normalized line.
+    void assemble_instruction( std::string_view text );
+    /// Adds a reference to a label at a position of "code" (the bytes of the slot are pushed by the caller).
+    void add_fixup( Fixup::Kind kind, std::string_view label, size_t pos );
+    /// Returns the index of a label (which is added if it is new).
+    u32 label_id( std::string_view label );
+    /// Parses a hexadecimal number like std::stoi() (sign, "0x" prefix, up to the first invalid character). Logs an
+    /// error and returns false (with value 0) if it contains no digits or doesn't fit.
+    bool parse_number( std::string_view text, i32 &value );
+    /// Logs a message about the current line, which is then assembled again next time.
+    void report( const String &message, bool error );
+    /// Fills in the label reference fixups[index].
+    void link( size_t index );
+};
+
+/// Translates a blob of machine code bytes into a valid hex-file.
+void encode_hex_file( const std::vector<u8> &code, std::ostream &output );
+
+/// Compiles assembly code into machine code and writes it in hex-format to a file.
+/// Accepted instruction syntax:
+/// Commas between parameters are optional.
+/// All numbers are interpreted in base 16.
+/// Addresses are generally written in parenthesis or as SFRs.
+/// The first parameter is always an address (and thus need no additional parenthesis).
+/// Some registers are used as indirection address when written in parenthesis.
+/// Keep in mind that assembler and disassembler are distinct systems, i. e. the syntax and registers of one don't
+/// always apply to the other.
+/// Bits can't be accessed with syntax like "A.1". Still some common bits (like C) can be used (see sfr_symbols in
+/// InstructionSet.hpp) directly.
+/// You will most likely need to wrap bit addresses in parenthesis, as they are treated like normal addresses and
+/// thus need indirection.
+void compile_assembly( const String &code, std::ostream &output );
+/// Compiles assembly code and loads the machine code and the labels directly into a processor (which is reset like by
+/// Processor::load_hex_code()). The code is also written in hex-format to "hex_output" if given. Returns true on
+/// success.
+bool compile_assembly( const String &code, Processor &processor, std::ostream *hex_output = nullptr );
@@ -0,0 +1,49 @@
+#pragma once
+
+#include "sim8051/stdafx.hpp"
+
+/// Fixed-size set of bits which exposes its 64 bit words, so that whole bitmaps can be merged or stored cheaply.
+template <size_t N>
+struct Bitmap {
+    static constexpr size_t bit_count = N;
+    static constexpr size_t word_count = ( N + 63 ) / 64;
+
+    std::array<u64, word_count> words = {};
+
+    bool test( size_t idx ) const { return ( words[idx >> 6] >> ( idx & 63 ) ) & 1; }
+    void set( size_t idx ) { words[idx >> 6] |= static_cast<u64>( 1 ) << ( idx & 63 ); }
+    void clear( size_t idx ) { words[idx >> 6] &= ~( static_cast<u64>( 1 ) << ( idx & 63 ) ); }
+    void set_to( size_t idx, bool value ) {
+        if ( value )
+            set( idx );
+        else
+            clear( idx );
+    }
+
+    /// Clears all bits.
+    void reset() { words.fill( 0 ); }
+
+    /// Returns whether any bit is set.
+    bool any() const {
+        for ( auto word : words ) {
+            if ( word != 0 )
+                return true;
+        }
+        return false;
+    }
+
+    /// Returns the number of set bits.
+    size_t count() const {
+        size_t ret = 0;
+        for ( auto word : words )
+            ret += std::bitset<64>( word ).count();
+        return ret;
+    }
+
+    /// Merges another bitmap into this one (bitwise or).
+    Bitmap &operator|=( const Bitmap &other ) {
+        for ( size_t i = 0; i < word_count; i++ )
+            words[i] |= other.words[i];
+        return *this;
+    }
+};
@@ -0,0 +1,54 @@
+#pragma once
+
+#include "sim8051/stdafx.hpp"
+#include "sim8051/Bitmap.hpp"
+#include "sim8051/Processor.hpp"
+
+/// Instruction boundaries of the program in code memory. The code is decoded by following the control flow (recursive
+/// descent) from the reset vector: jumps, calls and branches are followed, returns and indirect jumps end a path. The
+/// interrupt vectors are only decoded if the program writes IE. Bytes which are never reached (tables, strings,
+/// padding) are data.
+/// An address which is loaded into DPTR and reaches a MOVC A, @A+DPTR on the same path (also in a called subroutine) is
+/// assumed to be a table, so a path which runs into it ends there (unless it's also a jump target). Other DPTR values
+/// (e. g. XRAM pointers) don't affect the decoding.
+class CodeMap {
+public:
+    static constexpr size_t size = 64 * 1024;
+    static constexpr u8 data_row_size = 8; // Maximum number of data bytes in a listing row.
+
+    Bitmap<size> instructions; // First bytes of the reachable instructions.
+    Bitmap<size> code; // All bytes of the reachable instructions.
+    std::vector<u16> entry_points; // Additional entry points (e. g. targets of JMP @A+DPTR which were executed).
+
+    /// Decodes a program from scratch (the additional entry points are removed).
+    void build( const Processor &processor );
+
+    /// Decodes the program again after code memory was changed (e. g. a partial reload), keeping the additional entry
+    /// points. Returns the address range [first, second) in which bytes or instruction boundaries changed, so views
+    /// only have to update this region (empty if nothing changed).
+    std::pair<size_t, size_t> update( const Processor &processor );
+
+    /// Adds an entry point and decodes the code which is reachable from it. Returns false if the address is inside an
+    /// instruction.
+    bool add_entry_point( u16 addr );
+
+    /// Returns the addresses of the listing rows: every instruction and runs of up to data_row_size data bytes.
+    std::vector<u16> list() const;
+
+    /// Returns the number of bytes of a listing row.
+    u8 row_size( u16 addr ) const;
+
+private:
+    std::array<u8, size> bytes = {}; // Decoded copy of code memory.
+    Bitmap<size> tables; // Values of DPTR which were used by MOVC A, @A+DPTR.
+    bool interrupts_enabled = false; // The decoded code writes IE.
+
+    /// Clears the decoding and decodes from all entry points.
+    void decode();
+    /// Returns whether the instruction at an address writes a direct address (or one of its bits).
+    bool writes_direct( size_t addr, u8 direct ) const;
+    /// Decodes all paths from an address.
+    void trace( u16 entry );
+    /// Decodes the used interrupt vectors (call once interrupts_enabled is set).
+    void trace_vectors();
+};
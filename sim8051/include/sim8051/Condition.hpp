@@ -0,0 +1,55 @@
+#pragma once
+
+#include "sim8051/stdafx.hpp"
+
+/// Precompiled breakpoint condition. The expression is translated into a small stack-based bytecode once, so
+/// evaluating it (see Processor::evaluate()) doesn't need any parsing or allocations.
+struct Condition {
+    enum Op : u8 {
+        push, // Push the constant "arg".
+        load_direct, // Push the byte at direct address "arg".
+        load_bit, // Push the bit at bit address "arg".
+        load_reg, // Push register R"arg" of the current register bank.
+        load_iram, // Pop an address and push the byte in internal RAM.
+        load_xram, // Pop an address and push the byte in external RAM.
+        load_code, // Pop an address and push the byte in program memory.
+        load_pc,
+        load_dptr,
+        load_cycles,
+        negate,
+        logical_not,
+        bitwise_not,
+        mul,
+        add,
+        sub,
+        bitwise_and,
+        bitwise_xor,
+        bitwise_or,
+        eq,
+        ne,
+        lt,
+        le,
+        gt,
+        ge,
+        logical_and,
+        logical_or,
+    };
+    struct Instruction {
+        Op op;
+        u32 arg;
+    };
+
+    static constexpr size_t max_stack_size = 16;
+
+    std::vector<Instruction> code; // Empty conditions are always true.
+};
+
+/// Compiles a condition expression. Returns true on success.
+/// Syntax: C-like expressions with the operators || && == != < <= > >= | ^ & + - * ! ~ and parentheses. "and", "or" and
+/// "not" can be used instead of the symbols. Bitwise operators bind stronger than comparisons.
+/// Numbers are hexadecimal (with optional "0x" prefix), like everywhere else in the simulator. Names take precedence,
+/// so numbers which are also names (like C or F0) need the prefix.
+/// Values: A, B, R0-R7, PC, DPTR, CYCLES, all SFR and bit names known to the assembler (like PSW, SP, TCON, C, OV),
+/// IRAM[expr], XRAM[expr] and CODE[expr]. Names are case-insensitive.
+/// Example: "R7 == 0 and XRAM[DPTR] > 40".
+bool compile_condition( const String &expression, Condition &condition );
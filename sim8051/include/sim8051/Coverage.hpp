@@ -0,0 +1,34 @@
+#pragma once
+
+#include "sim8051/stdafx.hpp"
+#include "sim8051/Bitmap.hpp"
+
+class Processor;
+
+/// Records which instructions were executed and which way conditional branches went.
+/// Coverage of multiple runs is combined by or-ing the bitmaps, so merging is independent of the run length.
+struct Coverage {
+    Bitmap<64 * 1024> executed; // Addresses of executed instructions.
+    Bitmap<64 * 1024> branch_taken; // Addresses of conditional branches which jumped at least once.
+    Bitmap<64 * 1024> branch_not_taken; // Addresses of conditional branches which fell through at least once.
+
+    /// Forgets all recorded coverage.
+    void clear();
+
+    /// Adds the coverage of another run to this one.
+    void merge( const Coverage &other );
+
+    /// Stores the raw bitmaps in a binary file. Returns true on success.
+    bool save( const String &file ) const;
+
+    /// Loads raw bitmaps stored with save(). Returns true on success.
+    bool load( const String &file );
+
+    /// Writes a disassembly listing of the program with one instruction per line. The line numbers are the ones which
+    /// are referenced by write_lcov().
+    void write_listing( std::ostream &output, const Processor &processor ) const;
+
+    /// Writes the coverage in lcov tracefile format (e. g. for genhtml). "source_name" should name the listing written
+    /// with write_listing().
+    void write_lcov( std::ostream &output, const Processor &processor, const String &source_name ) const;
+};
@@ -5,27 +5,71 @@
 
 String to_hex_str( u16 val, u8 bit = 8 );
 String to_hex_str_signed( i8 val );
+/// Writes the lowest "digits" hexadecimal digits of a value (lower case, without allocating).
+void write_hex( char *output, u32 val, u8 digits );
 
-/// Decode instructions to detect single op codes.
-void decode_instructions( const Processor &processor, std::vector<u16> &op_code_indices );
+/// Disassembled instruction for views which show it on every frame. The text is decoded once and only the digits of
+/// live operand values (registers, memory, bits) are rewritten when they changed.
+struct DisassemblyRow {
+    /// Processor state shown in the text.
+    struct LiveValue {
+        enum Kind : u8 {
+            acc,
+            b,
+            reg, // "arg" is the register number (current bank).
+            iram_indirect, // @Ri, "arg" is i.
+            xram_indirect, // MOVX @Ri, "arg" is i (P2 is the high byte).
+            direct, // "arg" is the direct address.
+            bit, // "arg" is the bit address.
+            dptr,
+            xram_dptr,
+            code_a_dptr,
+            a_dptr_target, // Jump target of JMP @A+DPTR.
+            code_a_pc, // "arg" is the address after the instruction.
+            addr11, // "arg" is the address within the 2K page of the program counter.
+        };
+        Kind kind;
+        u16 arg;
+        u8 position; // Of the first digit in "text".
+        u8 digits;
+        u32 value = ~0u; // Currently shown value (none after decoding).
+    };
+
+    String text; // Bytes, mnemonic and operands (without address).
+    std::array<LiveValue, 3> values;
+    u8 value_count = 0;
+};
 
 /// Decodes instructions and translates them into a humand-readable string with live data from the processor.
-String get_decoded_instruction_string( Processor &processor, u16 code_addr );
+String get_decoded_instruction_string( const Processor &processor, u16 code_addr );
+
+/// Decodes an instruction for a disassembly view (the live values are filled in by update_disassembly_row()).
+DisassemblyRow decode_disassembly_row( const Processor &processor, u16 code_addr );
+
+/// Creates a disassembly row for "size" data bytes (no live values).
+DisassemblyRow decode_data_row( const Processor &processor, u16 code_addr, u8 size );
+
+/// Rewrites the live values of a row which changed. Doesn't allocate.
+void update_disassembly_row( DisassemblyRow &row, const Processor &processor );
+
+/// Returns the size in bytes of an instruction (including the op code).
+u8 get_instruction_size( u8 opcode );
+
+/// Returns whether the op code jumps depending on a condition (JZ, JB, CJNE, DJNZ, ...).
+bool is_conditional_branch( u8 opcode );
+
+/// Translates an instruction into a static listing line (address, bytes and signature; no live data).
+String get_instruction_listing_string( const Processor &processor, u16 code_addr );
+
+/// Translates an SFR or bit name (as used by the assembler, case-insensitive) into its address.
+/// "is_bit" is set if the name is a bit address (like "C" or "OV"). Returns false for unknown names.
+bool lookup_sfr_name( const String &name, u8 &addr, bool &is_bit );
+
+/// Returns the name of an SFR address (empty for invalid addresses).
+String sfr_name( u8 addr );
+
+/// Returns the human-readable name of an address space.
+String mem_space_name( MemSpace space );
 
 /// Transfers all characters of an ASCII-String to lower case.
 String to_lower( const String &str );
-
-/// Compiles assembly code into machine code and writes it in hex-format to a file.
-/// Accepted instruction syntax:
-/// Commas between parameters are optional.
-/// All numbers are interpreted in base 16.
-/// Addresses are generally written in parenthesis or as SFRs.
-/// The first parameter is always an address (and thus need no additional parenthesis).
-/// Some registers are used as indirection address when written in parenthesis.
-/// Keep in mind that assembler and disassembler are distinct systems, i. e. the syntax and registers of one don't
-/// always apply to the other.
-/// Bits can't be accessed with syntax like "A.1". Still some common bits (like C) can be used (see table rev_sfr_map
-/// below) directly.
-/// You will most likely need to wrap bit addresses in parenthesis, as they are treated like normal addresses and
-/// thus need indirection.
-void compile_assembly( const String &code, std::ostream &output );
@@ -0,0 +1,33 @@
+#pragma once
+
+#include "sim8051/stdafx.hpp"
+#include "sim8051/PagedMemory.hpp"
+
+/// Read-only content of a file. Regular files are memory mapped where possible, so large images are parsed without
+/// copying them; pipes and other files are read into memory.
+class MappedFile {
+public:
+    /// Opens a file (check is_open()).
+    explicit MappedFile( const String &path );
+    MappedFile( const MappedFile & ) = delete;
+    MappedFile &operator=( const MappedFile & ) = delete;
+    ~MappedFile();
+
+    bool is_open() const { return open; }
+    std::string_view content() const { return { data, size }; }
+
+private:
+    const char *data = nullptr;
+    size_t size = 0;
+    bool open = false;
+    bool mapped = false; // "data" must be unmapped (else it points into "buffer").
+    std::vector<char> buffer;
+};
+
+/// Parses Intel HEX records into code memory. Supported are data (00), end of file (01), extended segment address (02),
+/// start segment address (03), extended linear address (04) and start linear address (05) records, so the data can be
+/// split into segments in any order. The start addresses are ignored, as the 8051 always starts at 0. Text in front
+/// of the ":" of a record, CRLF line endings and empty lines are ignored, as is everything after the end of file
+/// record.
+/// Errors are logged with line and column ("<name>:<line>:<column>: <message>"). Returns true on success.
+bool parse_hex_image( std::string_view text, PagedMemory<64 * 1024> &memory, const String &name );
@@ -0,0 +1,432 @@
+#pragma once
+
+#include "sim8051/stdafx.hpp"
+
+/// Mnemonics of the 8051 instruction set.
+enum class Mnemonic : u8 {
+    acall,
+    add,
+    addc,
+    ajmp,
+    anl,
+    cjne,
+    clr,
+    cpl,
+    da,
+    dec,
+    div,
+    djnz,
+    inc,
+    jb,
+    jbc,
+    jc,
+    jmp,
+    jnb,
+    jnc,
+    jnz,
+    jz,
+    lcall,
+    ljmp,
+    mov,
+    movc,
+    movx,
+    mul,
+    nop,
+    orl,
+    pop,
+    push,
+    ret,
+    reti,
+    rl,
+    rlc,
+    rr,
+    rrc,
+    setb,
+    sjmp,
+    subb,
+    swap,
+    xch,
+    xchd,
+    xrl,
+    reserved,
+};
+
+/// Kinds of instruction operands. The registers R0 to R7 are consecutive.
+enum class Operand : u8 {
+    none,
+    a,
+    b,
+    c, // Carry flag.
+    dptr,
+    r0,
+    r1,
+    r2,
+    r3,
+    r4,
+    r5,
+    r6,
+    r7,
+    at_r0,
+    at_r1,
+    at_dptr,
+    at_a_dptr,
+    at_a_pc,
+    direct, // Direct address (1 byte).
+    bit, // Bit address (1 byte).
+    not_bit, // Complement of a bit (1 byte).
+    immediate, // 8 bit constant (1 byte).
+    immediate16, // 16 bit constant (2 bytes, high byte first).
+    addr11, // Address in the 2K page of the next instruction (3 bits in the op code, 1 byte).
+    addr16, // Absolute address (2 bytes, high byte first).
+    offset, // Signed offset relative to the next instruction (1 byte).
+};
+
+/// Description of an op code, shared by the simulator, the disassembler and the assembler.
+struct InstructionInfo {
+    Mnemonic mnemonic;
+    u8 size; // Bytes including the op code.
+    u8 cycles; // Machine cycles.
+    std::array<Operand, 3> operands; // In assembler order, unused ones are Operand::none.
+
+    constexpr InstructionInfo( Mnemonic mnemonic, u8 size, u8 cycles, Operand first = Operand::none,
+                               Operand second = Operand::none, Operand third = Operand::none )
+            : mnemonic( mnemonic ), size( size ), cycles( cycles ), operands{ first, second, third } {}
+
+    constexpr u8 operand_count() const {
+        u8 count = 0;
+        while ( count < operands.size() && operands[count] != Operand::none )
+            count++;
+        return count;
+    }
+};
+
+/// All 256 op codes, indexed by the op code.
+inline constexpr std::array<InstructionInfo, 256> instruction_set = { {
+    { Mnemonic::nop, 1, 1 }, // 0x00
+    { Mnemonic::ajmp, 2, 2, Operand::addr11 }, // 0x01
+    { Mnemonic::ljmp, 3, 2, Operand::addr16 }, // 0x02
+    { Mnemonic::rr, 1, 1, Operand::a }, // 0x03
+    { Mnemonic::inc, 1, 1, Operand::a }, // 0x04
+    { Mnemonic::inc, 2, 1, Operand::direct }, // 0x05
+    { Mnemonic::inc, 1, 1, Operand::at_r0 }, // 0x06
+    { Mnemonic::inc, 1, 1, Operand::at_r1 }, // 0x07
+    { Mnemonic::inc, 1, 1, Operand::r0 }, // 0x08
+    { Mnemonic::inc, 1, 1, Operand::r1 }, // 0x09
+    { Mnemonic::inc, 1, 1, Operand::r2 }, // 0x0A
+    { Mnemonic::inc, 1, 1, Operand::r3 }, // 0x0B
+    { Mnemonic::inc, 1, 1, Operand::r4 }, // 0x0C
+    { Mnemonic::inc, 1, 1, Operand::r5 }, // 0x0D
+    { Mnemonic::inc, 1, 1, Operand::r6 }, // 0x0E
+    { Mnemonic::inc, 1, 1, Operand::r7 }, // 0x0F
+    { Mnemonic::jbc, 3, 2, Operand::bit, Operand::offset }, // 0x10
+    { Mnemonic::acall, 2, 2, Operand::addr11 }, // 0x11
+    { Mnemonic::lcall, 3, 2, Operand::addr16 }, // 0x12
+    { Mnemonic::rrc, 1, 1, Operand::a }, // 0x13
+    { Mnemonic::dec, 1, 1, Operand::a }, // 0x14
+    { Mnemonic::dec, 2, 1, Operand::direct }, // 0x15
+    { Mnemonic::dec, 1, 1, Operand::at_r0 }, // 0x16
+    { Mnemonic::dec, 1, 1, Operand::at_r1 }, // 0x17
+    { Mnemonic::dec, 1, 1, Operand::r0 }, // 0x18
+    { Mnemonic::dec, 1, 1, Operand::r1 }, // 0x19
+    { Mnemonic::dec, 1, 1, Operand::r2 }, // 0x1A
+    { Mnemonic::dec, 1, 1, Operand::r3 }, // 0x1B
+    { Mnemonic::dec, 1, 1, Operand::r4 }, // 0x1C
+    { Mnemonic::dec, 1, 1, Operand::r5 }, // 0x1D
+    { Mnemonic::dec, 1, 1, Operand::r6 }, // 0x1E
+    { Mnemonic::dec, 1, 1, Operand::r7 }, // 0x1F
+    { Mnemonic::jb, 3, 2, Operand::bit, Operand::offset }, // 0x20
+    { Mnemonic::ajmp, 2, 2, Operand::addr11 }, // 0x21
+    { Mnemonic::ret, 1, 2 }, // 0x22
+    { Mnemonic::rl, 1, 1, Operand::a }, // 0x23
+    { Mnemonic::add, 2, 1, Operand::a, Operand::immediate }, // 0x24
+    { Mnemonic::add, 2, 1, Operand::a, Operand::direct }, // 0x25
+    { Mnemonic::add, 1, 1, Operand::a, Operand::at_r0 }, // 0x26
+    { Mnemonic::add, 1, 1, Operand::a, Operand::at_r1 }, // 0x27
+    { Mnemonic::add, 1, 1, Operand::a, Operand::r0 }, // 0x28
+    { Mnemonic::add, 1, 1, Operand::a, Operand::r1 }, // 0x29
+    { Mnemonic::add, 1, 1, Operand::a, Operand::r2 }, // 0x2A
+    { Mnemonic::add, 1, 1, Operand::a, Operand::r3 }, // 0x2B
+    { Mnemonic::add, 1, 1, Operand::a, Operand::r4 }, // 0x2C
+    { Mnemonic::add, 1, 1, Operand::a, Operand::r5 }, // 0x2D
+    { Mnemonic::add, 1, 1, Operand::a, Operand::r6 }, // 0x2E
+    { Mnemonic::add, 1, 1, Operand::a, Operand::r7 }, // 0x2F
+    { Mnemonic::jnb, 3, 2, Operand::bit, Operand::offset }, // 0x30
+    { Mnemonic::acall, 2, 2, Operand::addr11 }, // 0x31
+    { Mnemonic::reti, 1, 2 }, // 0x32
+    { Mnemonic::rlc, 1, 1, Operand::a }, // 0x33
+    { Mnemonic::addc, 2, 1, Operand::a, Operand::immediate }, // 0x34
+    { Mnemonic::addc, 2, 1, Operand::a, Operand::direct }, // 0x35
+    { Mnemonic::addc, 1, 1, Operand::a, Operand::at_r0 }, // 0x36
+    { Mnemonic::addc, 1, 1, Operand::a, Operand::at_r1 }, // 0x37
+    { Mnemonic::addc, 1, 1, Operand::a, Operand::r0 }, // 0x38
+    { Mnemonic::addc, 1, 1, Operand::a, Operand::r1 }, // 0x39
+    { Mnemonic::addc, 1, 1, Operand::a, Operand::r2 }, // 0x3A
+    { Mnemonic::addc, 1, 1, Operand::a, Operand::r3 }, // 0x3B
+    { Mnemonic::addc, 1, 1, Operand::a, Operand::r4 }, // 0x3C
+    { Mnemonic::addc, 1, 1, Operand::a, Operand::r5 }, // 0x3D
+    { Mnemonic::addc, 1, 1, Operand::a, Operand::r6 }, // 0x3E
+    { Mnemonic::addc, 1, 1, Operand::a, Operand::r7 }, // 0x3F
+    { Mnemonic::jc, 2, 2, Operand::offset }, // 0x40
+    { Mnemonic::ajmp, 2, 2, Operand::addr11 }, // 0x41
+    { Mnemonic::orl, 2, 1, Operand::direct, Operand::a }, // 0x42
+    { Mnemonic::orl, 3, 2, Operand::direct, Operand::immediate }, // 0x43
+    { Mnemonic::orl, 2, 1, Operand::a, Operand::immediate }, // 0x44
+    { Mnemonic::orl, 2, 1, Operand::a, Operand::direct }, // 0x45
+    { Mnemonic::orl, 1, 1, Operand::a, Operand::at_r0 }, // 0x46
+    { Mnemonic::orl, 1, 1, Operand::a, Operand::at_r1 }, // 0x47
+    { Mnemonic::orl, 1, 1, Operand::a, Operand::r0 }, // 0x48
+    { Mnemonic::orl, 1, 1, Operand::a, Operand::r1 }, // 0x49
+    { Mnemonic::orl, 1, 1, Operand::a, Operand::r2 }, // 0x4A
+    { Mnemonic::orl, 1, 1, Operand::a, Operand::r3 }, // 0x4B
+    { Mnemonic::orl, 1, 1, Operand::a, Operand::r4 }, // 0x4C
+    { Mnemonic::orl, 1, 1, Operand::a, Operand::r5 }, // 0x4D
+    { Mnemonic::orl, 1, 1, Operand::a, Operand::r6 }, // 0x4E
+    { Mnemonic::orl, 1, 1, Operand::a, Operand::r7 }, // 0x4F
+    { Mnemonic::jnc, 2, 2, Operand::offset }, // 0x50
+    { Mnemonic::acall, 2, 2, Operand::addr11 }, // 0x51
+    { Mnemonic::anl, 2, 1, Operand::direct, Operand::a }, // 0x52
+    { Mnemonic::anl, 3, 2, Operand::direct, Operand::immediate }, // 0x53
+    { Mnemonic::anl, 2, 1, Operand::a, Operand::immediate }, // 0x54
+    { Mnemonic::anl, 2, 1, Operand::a, Operand::direct }, // 0x55
+    { Mnemonic::anl, 1, 1, Operand::a, Operand::at_r0 }, // 0x56
+    { Mnemonic::anl, 1, 1, Operand::a, Operand::at_r1 }, // 0x57
+    { Mnemonic::anl, 1, 1, Operand::a, Operand::r0 }, // 0x58
+    { Mnemonic::anl, 1, 1, Operand::a, Operand::r1 }, // 0x59
+    { Mnemonic::anl, 1, 1, Operand::a, Operand::r2 }, // 0x5A
+    { Mnemonic::anl, 1, 1, Operand::a, Operand::r3 }, // 0x5B
+    { Mnemonic::anl, 1, 1, Operand::a, Operand::r4 }, // 0x5C
+    { Mnemonic::anl, 1, 1, Operand::a, Operand::r5 }, // 0x5D
+    { Mnemonic::anl, 1, 1, Operand::a, Operand::r6 }, // 0x5E
+    { Mnemonic::anl, 1, 1, Operand::a, Operand::r7 }, // 0x5F
+    { Mnemonic::jz, 2, 2, Operand::offset }, // 0x60
+    { Mnemonic::ajmp, 2, 2, Operand::addr11 }, // 0x61
+    { Mnemonic::xrl, 2, 1, Operand::direct, Operand::a }, // 0x62
+    { Mnemonic::xrl, 3, 2, Operand::direct, Operand::immediate }, // 0x63
+    { Mnemonic::xrl, 2, 1, Operand::a, Operand::immediate }, // 0x64
+    { Mnemonic::xrl, 2, 1, Operand::a, Operand::direct }, // 0x65
+    { Mnemonic::xrl, 1, 1, Operand::a, Operand::at_r0 }, // 0x66
+    { Mnemonic::xrl, 1, 1, Operand::a, Operand::at_r1 }, // 0x67
+    { Mnemonic::xrl, 1, 1, Operand::a, Operand::r0 }, // 0x68
+    { Mnemonic::xrl, 1, 1, Operand::a, Operand::r1 }, // 0x69
+    { Mnemonic::xrl, 1, 1, Operand::a, Operand::r2 }, // 0x6A
+    { Mnemonic::xrl, 1, 1, Operand::a, Operand::r3 }, // 0x6B
+    { Mnemonic::xrl, 1, 1, Operand::a, Operand::r4 }, // 0x6C
+    { Mnemonic::xrl, 1, 1, Operand::a, Operand::r5 }, // 0x6D
+    { Mnemonic::xrl, 1, 1, Operand::a, Operand::r6 }, // 0x6E
+    { Mnemonic::xrl, 1, 1, Operand::a, Operand::r7 }, // 0x6F
+    { Mnemonic::jnz, 2, 2, Operand::offset }, // 0x70
+    { Mnemonic::acall, 2, 2, Operand::addr11 }, // 0x71
+    { Mnemonic::orl, 2, 2, Operand::c, Operand::bit }, // 0x72
+    { Mnemonic::jmp, 1, 2, Operand::at_a_dptr }, // 0x73
+    { Mnemonic::mov, 2, 1, Operand::a, Operand::immediate }, // 0x74
+    { Mnemonic::mov, 3, 2, Operand::direct, Operand::immediate }, // 0x75
+    { Mnemonic::mov, 2, 1, Operand::at_r0, Operand::immediate }, // 0x76
+    { Mnemonic::mov, 2, 1, Operand::at_r1, Operand::immediate }, // 0x77
+    { Mnemonic::mov, 2, 1, Operand::r0, Operand::immediate }, // 0x78
+    { Mnemonic::mov, 2, 1, Operand::r1, Operand::immediate }, // 0x79
+    { Mnemonic::mov, 2, 1, Operand::r2, Operand::immediate }, // 0x7A
+    { Mnemonic::mov, 2, 1, Operand::r3, Operand::immediate }, // 0x7B
+    { Mnemonic::mov, 2, 1, Operand::r4, Operand::immediate }, // 0x7C
+    { Mnemonic::mov, 2, 1, Operand::r5, Operand::immediate }, // 0x7D
+    { Mnemonic::mov, 2, 1, Operand::r6, Operand::immediate }, // 0x7E
+    { Mnemonic::mov, 2, 1, Operand::r7, Operand::immediate }, // 0x7F
+    { Mnemonic::sjmp, 2, 2, Operand::offset }, // 0x80
+    { Mnemonic::ajmp, 2, 2, Operand::addr11 }, // 0x81
+    { Mnemonic::anl, 2, 2, Operand::c, Operand::bit }, // 0x82
+    { Mnemonic::movc, 1, 2, Operand::a, Operand::at_a_pc }, // 0x83
+    { Mnemonic::div, 1, 4, Operand::a, Operand::b }, // 0x84
+    { Mnemonic::mov, 3, 2, Operand::direct, Operand::direct }, // 0x85
+    { Mnemonic::mov, 2, 2, Operand::direct, Operand::at_r0 }, // 0x86
+    { Mnemonic::mov, 2, 2, Operand::direct, Operand::at_r1 }, // 0x87
+    { Mnemonic::mov, 2, 2, Operand::direct, Operand::r0 }, // 0x88
+    { Mnemonic::mov, 2, 2, Operand::direct, Operand::r1 }, // 0x89
+    { Mnemonic::mov, 2, 2, Operand::direct, Operand::r2 }, // 0x8A
+    { Mnemonic::mov, 2, 2, Operand::direct, Operand::r3 }, // 0x8B
+    { Mnemonic::mov, 2, 2, Operand::direct, Operand::r4 }, // 0x8C
+    { Mnemonic::mov, 2, 2, Operand::direct, Operand::r5 }, // 0x8D
+    { Mnemonic::mov, 2, 2, Operand::direct, Operand::r6 }, // 0x8E
+    { Mnemonic::mov, 2, 2, Operand::direct, Operand::r7 }, // 0x8F
+    { Mnemonic::mov, 3, 2, Operand::dptr, Operand::immediate16 }, // 0x90
+    { Mnemonic::acall, 2, 2, Operand::addr11 }, // 0x91
+    { Mnemonic::mov, 2, 2, Operand::bit, Operand::c }, // 0x92
+    { Mnemonic::movc, 1, 2, Operand::a, Operand::at_a_dptr }, // 0x93
+    { Mnemonic::subb, 2, 1, Operand::a, Operand::immediate }, // 0x94
+    { Mnemonic::subb, 2, 1, Operand::a, Operand::direct }, // 0x95
+    { Mnemonic::subb, 1, 1, Operand::a, Operand::at_r0 }, // 0x96
+    { Mnemonic::subb, 1, 1, Operand::a, Operand::at_r1 }, // 0x97
+    { Mnemonic::subb, 1, 1, Operand::a, Operand::r0 }, // 0x98
+    { Mnemonic::subb, 1, 1, Operand::a, Operand::r1 }, // 0x99
+    { Mnemonic::subb, 1, 1, Operand::a, Operand::r2 }, // 0x9A
+    { Mnemonic::subb, 1, 1, Operand::a, Operand::r3 }, // 0x9B
+    { Mnemonic::subb, 1, 1, Operand::a, Operand::r4 }, // 0x9C
+    { Mnemonic::subb, 1, 1, Operand::a, Operand::r5 }, // 0x9D
+    { Mnemonic::subb, 1, 1, Operand::a, Operand::r6 }, // 0x9E
+    { Mnemonic::subb, 1, 1, Operand::a, Operand::r7 }, // 0x9F
+    { Mnemonic::orl, 2, 2, Operand::c, Operand::not_bit }, // 0xA0
+    { Mnemonic::ajmp, 2, 2, Operand::addr11 }, // 0xA1
+    { Mnemonic::mov, 2, 1, Operand::c, Operand::bit }, // 0xA2
+    { Mnemonic::inc, 1, 2, Operand::dptr }, // 0xA3
+    { Mnemonic::mul, 1, 4, Operand::a, Operand::b }, // 0xA4
+    { Mnemonic::reserved, 1, 1 }, // 0xA5
+    { Mnemonic::mov, 2, 2, Operand::at_r0, Operand::direct }, // 0xA6
+    { Mnemonic::mov, 2, 2, Operand::at_r1, Operand::direct }, // 0xA7
+    { Mnemonic::mov, 2, 2, Operand::r0, Operand::direct }, // 0xA8
+    { Mnemonic::mov, 2, 2, Operand::r1, Operand::direct }, // 0xA9
+    { Mnemonic::mov, 2, 2, Operand::r2, Operand::direct }, // 0xAA
+    { Mnemonic::mov, 2, 2, Operand::r3, Operand::direct }, // 0xAB
+    { Mnemonic::mov, 2, 2, Operand::r4, Operand::direct }, // 0xAC
+    { Mnemonic::mov, 2, 2, Operand::r5, Operand::direct }, // 0xAD
+    { Mnemonic::mov, 2, 2, Operand::r6, Operand::direct }, // 0xAE
+    { Mnemonic::mov, 2, 2, Operand::r7, Operand::direct }, // 0xAF
+    { Mnemonic::anl, 2, 2, Operand::c, Operand::not_bit }, // 0xB0
+    { Mnemonic::acall, 2, 2, Operand::addr11 }, // 0xB1
+    { Mnemonic::cpl, 2, 1, Operand::bit }, // 0xB2
+    { Mnemonic::cpl, 1, 1, Operand::c }, // 0xB3
+    { Mnemonic::cjne, 3, 2, Operand::a, Operand::immediate, Operand::offset }, // 0xB4
+    { Mnemonic::cjne, 3, 2, Operand::a, Operand::direct, Operand::offset }, // 0xB5
+    { Mnemonic::cjne, 3, 2, Operand::at_r0, Operand::immediate, Operand::offset }, // 0xB6
+    { Mnemonic::cjne, 3, 2, Operand::at_r1, Operand::immediate, Operand::offset }, // 0xB7
+    { Mnemonic::cjne, 3, 2, Operand::r0, Operand::immediate, Operand::offset }, // 0xB8
+    { Mnemonic::cjne, 3, 2, Operand::r1, Operand::immediate, Operand::offset }, // 0xB9
+    { Mnemonic::cjne, 3, 2, Operand::r2, Operand::immediate, Operand::offset }, // 0xBA
+    { Mnemonic::cjne, 3, 2, Operand::r3, Operand::immediate, Operand::offset }, // 0xBB
+    { Mnemonic::cjne, 3, 2, Operand::r4, Operand::immediate, Operand::offset }, // 0xBC
+    { Mnemonic::cjne, 3, 2, Operand::r5, Operand::immediate, Operand::offset }, // 0xBD
+    { Mnemonic::cjne, 3, 2, Operand::r6, Operand::immediate, Operand::offset }, // 0xBE
+    { Mnemonic::cjne, 3, 2, Operand::r7, Operand::immediate, Operand::offset }, // 0xBF
+    { Mnemonic::push, 2, 2, Operand::direct }, // 0xC0
+    { Mnemonic::ajmp, 2, 2, Operand::addr11 }, // 0xC1
+    { Mnemonic::clr, 2, 1, Operand::bit }, // 0xC2
+    { Mnemonic::clr, 1, 1, Operand::c }, // 0xC3
+    { Mnemonic::swap, 1, 1, Operand::a }, // 0xC4
+    { Mnemonic::xch, 2, 1, Operand::a, Operand::direct }, // 0xC5
+    { Mnemonic::xch, 1, 1, Operand::a, Operand::at_r0 }, // 0xC6
+    { Mnemonic::xch, 1, 1, Operand::a, Operand::at_r1 }, // 0xC7
+    { Mnemonic::xch, 1, 1, Operand::a, Operand::r0 }, // 0xC8
+    { Mnemonic::xch, 1, 1, Operand::a, Operand::r1 }, // 0xC9
+    { Mnemonic::xch, 1, 1, Operand::a, Operand::r2 }, // 0xCA
+    { Mnemonic::xch, 1, 1, Operand::a, Operand::r3 }, // 0xCB
+    { Mnemonic::xch, 1, 1, Operand::a, Operand::r4 }, // 0xCC
+    { Mnemonic::xch, 1, 1, Operand::a, Operand::r5 }, // 0xCD
+    { Mnemonic::xch, 1, 1, Operand::a, Operand::r6 }, // 0xCE
+    { Mnemonic::xch, 1, 1, Operand::a, Operand::r7 }, // 0xCF
+    { Mnemonic::pop, 2, 2, Operand::direct }, // 0xD0
+    { Mnemonic::acall, 2, 2, Operand::addr11 }, // 0xD1
+    { Mnemonic::setb, 2, 1, Operand::bit }, // 0xD2
+    { Mnemonic::setb, 1, 1, Operand::c }, // 0xD3
+    { Mnemonic::da, 1, 1, Operand::a }, // 0xD4
+    { Mnemonic::djnz, 3, 2, Operand::direct, Operand::offset }, // 0xD5
+    { Mnemonic::xchd, 1, 1, Operand::a, Operand::at_r0 }, // 0xD6
+    { Mnemonic::xchd, 1, 1, Operand::a, Operand::at_r1 }, // 0xD7
+    { Mnemonic::djnz, 2, 2, Operand::r0, Operand::offset }, // 0xD8
+    { Mnemonic::djnz, 2, 2, Operand::r1, Operand::offset }, // 0xD9
+    { Mnemonic::djnz, 2, 2, Operand::r2, Operand::offset }, // 0xDA
+    { Mnemonic::djnz, 2, 2, Operand::r3, Operand::offset }, // 0xDB
+    { Mnemonic::djnz, 2, 2, Operand::r4, Operand::offset }, // 0xDC
+    { Mnemonic::djnz, 2, 2, Operand::r5, Operand::offset }, // 0xDD
+    { Mnemonic::djnz, 2, 2, Operand::r6, Operand::offset }, // 0xDE
+    { Mnemonic::djnz, 2, 2, Operand::r7, Operand::offset }, // 0xDF
+    { Mnemonic::movx, 1, 2, Operand::a, Operand::at_dptr }, // 0xE0
+    { Mnemonic::ajmp, 2, 2, Operand::addr11 }, // 0xE1
+    { Mnemonic::movx, 1, 2, Operand::a, Operand::at_r0 }, // 0xE2
+    { Mnemonic::movx, 1, 2, Operand::a, Operand::at_r1 }, // 0xE3
+    { Mnemonic::clr, 1, 1, Operand::a }, // 0xE4
+    { Mnemonic::mov, 2, 1, Operand::a, Operand::direct }, // 0xE5
+    { Mnemonic::mov, 1, 1, Operand::a, Operand::at_r0 }, // 0xE6
+    { Mnemonic::mov, 1, 1, Operand::a, Operand::at_r1 }, // 0xE7
+    { Mnemonic::mov, 1, 1, Operand::a, Operand::r0 }, // 0xE8
+    { Mnemonic::mov, 1, 1, Operand::a, Operand::r1 }, // 0xE9
+    { Mnemonic::mov, 1, 1, Operand::a, Operand::r2 }, // 0xEA
+    { Mnemonic::mov, 1, 1, Operand::a, Operand::r3 }, // 0xEB
+    { Mnemonic::mov, 1, 1, Operand::a, Operand::r4 }, // 0xEC
+    { Mnemonic::mov, 1, 1, Operand::a, Operand::r5 }, // 0xED
+    { Mnemonic::mov, 1, 1, Operand::a, Operand::r6 }, // 0xEE
+    { Mnemonic::mov, 1, 1, Operand::a, Operand::r7 }, // 0xEF
+    { Mnemonic::movx, 1, 2, Operand::at_dptr, Operand::a }, // 0xF0
+    { Mnemonic::acall, 2, 2, Operand::addr11 }, // 0xF1
+    { Mnemonic::movx, 1, 2, Operand::at_r0, Operand::a }, // 0xF2
+    { Mnemonic::movx, 1, 2, Operand::at_r1, Operand::a }, // 0xF3
+    { Mnemonic::cpl, 1, 1, Operand::a }, // 0xF4
+    { Mnemonic::mov, 2, 1, Operand::direct, Operand::a }, // 0xF5
+    { Mnemonic::mov, 1, 1, Operand::at_r0, Operand::a }, // 0xF6
+    { Mnemonic::mov, 1, 1, Operand::at_r1, Operand::a }, // 0xF7
+    { Mnemonic::mov, 1, 1, Operand::r0, Operand::a }, // 0xF8
+    { Mnemonic::mov, 1, 1, Operand::r1, Operand::a }, // 0xF9
+    { Mnemonic::mov, 1, 1, Operand::r2, Operand::a }, // 0xFA
+    { Mnemonic::mov, 1, 1, Operand::r3, Operand::a }, // 0xFB
+    { Mnemonic::mov, 1, 1, Operand::r4, Operand::a }, // 0xFC
+    { Mnemonic::mov, 1, 1, Operand::r5, Operand::a }, // 0xFD
+    { Mnemonic::mov, 1, 1, Operand::r6, Operand::a }, // 0xFE
+    { Mnemonic::mov, 1, 1, Operand::r7, Operand::a }, // 0xFF
+} };
+
+/// Upper case names of the mnemonics (as shown by the disassembler), indexed by Mnemonic.
+inline constexpr const char *mnemonic_names[] = {
+    "ACALL", "ADD", "ADDC", "AJMP", "ANL", "CJNE", "CLR", "CPL", "DA", "DEC", "DIV", "DJNZ", "INC", "JB", "JBC", "JC",
+    "JMP", "JNB", "JNC", "JNZ", "JZ", "LCALL", "LJMP", "MOV", "MOVC", "MOVX", "MUL", "NOP", "ORL", "POP", "PUSH", "RET",
+    "RETI", "RL", "RLC", "RR", "RRC", "SETB", "SJMP", "SUBB", "SWAP", "XCH", "XCHD", "XRL", "reserved",
+};
+
+/// Names of the operands (as shown by the disassembler), indexed by Operand.
+inline constexpr const char *operand_names[] = {
+    "", "A", "B", "C", "DPTR", "R0", "R1", "R2", "R3", "R4", "R5", "R6", "R7", "@R0", "@R1", "@DPTR", "@A+DPTR",
+    "@A+PC", "direct", "bit", "/bit", "#immed", "#immed", "addr11", "addr16", "offset",
+};
+
+constexpr const char *mnemonic_name( Mnemonic mnemonic ) {
+    return mnemonic_names[static_cast<u8>( mnemonic )];
+}
+constexpr const char *operand_name( Operand operand ) {
+    return operand_names[static_cast<u8>( operand )];
+}
+
+/// Symbolic name of an SFR or bit address (lower case, as accepted by the assembler).
+struct SfrSymbol {
+    const char *name;
+    u8 addr;
+    bool is_bit;
+};
+
+inline constexpr SfrSymbol sfr_symbols[] = {
+    { "a", 0xE0, false },     { "b", 0xF0, false },    { "psw", 0xD0, false },  { "ip", 0xB8, false },
+    { "ie", 0xA8, false },    { "dpl", 0x82, false },  { "dph", 0x83, false },  { "p0", 0x80, false },
+    { "p1", 0x90, false },    { "p2", 0xA0, false },   { "p3", 0xB0, false },   { "pcon", 0x87, false },
+    { "scon", 0x98, false },  { "sbuf", 0x99, false }, { "tcon", 0x88, false }, { "t2con", 0xC8, false },
+    { "tmod", 0x89, false },  { "tl0", 0x9A, false },  { "tl1", 0x9B, false },  { "tl2", 0xCC, false },
+    { "th0", 0x9C, false },   { "th1", 0x9D, false },  { "th2", 0xCD, false },  { "sp", 0x81, false },
+    { "c", 0xD7, true },      { "p", 0xD0, true },     { "ov", 0xD2, true },    { "ac", 0xD6, true },
+    { "f0", 0xD5, true },     { "rs1", 0xD4, true },   { "rs0", 0xD3, true },   { "ud", 0xD1, true },
+};
+
+/// Returns the number of bytes an operand takes in the instruction.
+constexpr u8 operand_size( Operand operand ) {
+    switch ( operand ) {
+    case Operand::direct:
+    case Operand::bit:
+    case Operand::not_bit:
+    case Operand::immediate:
+    case Operand::addr11:
+    case Operand::offset:
+        return 1;
+    case Operand::immediate16:
+    case Operand::addr16:
+        return 2;
+    default:
+        return 0;
+    }
+}
+
+/// Returns whether the sizes of all op codes match their operands.
+constexpr bool instruction_sizes_match() {
+    for ( auto &info : instruction_set ) {
+        u8 size = 1;
+        for ( auto operand : info.operands )
+            size += operand_size( operand );
+        if ( size != info.size )
+            return false;
+    }
+    return true;
+}
+static_assert( instruction_sizes_match(), "The size of an op code doesn't match its operands" );
+static_assert( std::size( mnemonic_names ) == static_cast<size_t>( Mnemonic::reserved ) + 1 );
+static_assert( std::size( operand_names ) == static_cast<size_t>( Operand::offset ) + 1 );
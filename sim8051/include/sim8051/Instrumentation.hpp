@@ -0,0 +1,62 @@
+#pragma once
+
+#include "sim8051/stdafx.hpp"
+
+/// Address spaces which can be accessed by instructions.
+enum class MemSpace : u8 {
+    code, // Program memory (read by MOVC, executed).
+    iram, // Internal RAM (direct addresses below 0x80, indirect @Ri, registers and stack).
+    sfr, // Special function registers (direct addresses from 0x80, addressed with their full address).
+    xram, // External RAM (MOVX).
+};
+
+/// Something that happened during the simulation, reported to observers.
+struct Event {
+    enum Kind : u8 {
+        fetch, // An instruction is executed. "addr" is its address, "value" the op code.
+        read, // A byte is read (before the access). Implicit accesses to A, PSW and DPTR are not reported.
+        write, // A byte was written ("value" is the new value).
+        interrupt_entry, // "addr" is the interrupt vector, "value" is 1 for high priority interrupts.
+        interrupt_exit, // RETI, "addr" is the return address.
+        timer_overflow, // "addr" is the timer number, "value" the address of the flag bit which was set (or 0).
+    };
+
+    Kind kind;
+    MemSpace space; // Address space of fetch, read and write events.
+    u8 value;
+    u16 addr;
+    u64 cycle; // Cycle count of the instruction which caused the event.
+};
+
+/// Receives a batch of events.
+using Observer = std::function<void( const Event *events, size_t count )>;
+
+/// Collects events and delivers them to the registered observers in batches.
+/// The processor only reports events while at least one observer is registered. Without observers the simulation
+/// runs a variant of the instruction loop in which all reporting is compiled out.
+struct Instrumentation {
+    static constexpr size_t batch_size = 1024; // Events are delivered when this many were collected.
+
+    std::vector<std::pair<size_t, Observer>> observers; // With their ids.
+    std::vector<Event> buffer; // Undelivered events.
+    size_t next_id = 1;
+
+    /// Returns whether events should be reported.
+    bool active() const { return !observers.empty(); }
+
+    /// Adds an event to the current batch.
+    void record( const Event &event ) {
+        buffer.push_back( event );
+        if ( buffer.size() >= batch_size )
+            flush();
+    }
+
+    /// Registers an observer which gets all future events. Returns an id for remove_observer().
+    size_t add_observer( Observer observer );
+
+    /// Removes an observer (after delivering the pending events).
+    void remove_observer( size_t id );
+
+    /// Delivers all pending events. Observers must not add or remove observers while they are called.
+    void flush();
+};
@@ -0,0 +1,32 @@
+#pragma once
+
+#include "sim8051/stdafx.hpp"
+#include "sim8051/Processor.hpp"
+
+/// Simulates one step (instruction or interrupt entry) with a specific execution engine.
+using StepFunction = std::function<void( Processor & )>;
+
+/// First difference found by run_lockstep().
+struct Divergence {
+    size_t step; // Number of steps which were executed identically.
+    u16 pc; // Address of the instruction which caused the difference.
+    String instruction; // Decoded instruction at "pc" (before it was executed).
+    String diff; // Differences of the state (reference first).
+};
+
+/// Returns a human-readable list of differences in the architectural state (PC, cycle count, SFRs, internal and
+/// external RAM). Registers are named, other bytes are listed with their addresses. Returns an empty string if both are
+/// equal.
+String diff_state( const Processor &reference, const Processor &candidate );
+
+/// Runs two engines side by side for "steps" steps, starting at the state of "reference" and "candidate" (which
+/// should be equal). The states are compared after every "block_size" steps. On a difference both are rewound to the
+/// last equal state and stepped one by one, so the first diverging instruction is reported.
+/// "executed_opcodes" (if not null) counts executed op codes.
+std::optional<Divergence> run_lockstep( Processor &reference, Processor &candidate, const StepFunction &reference_step,
+                                        const StepFunction &candidate_step, size_t steps, size_t block_size = 1,
+                                        std::array<size_t, 256> *executed_opcodes = nullptr );
+
+/// Fills the processor with a random instruction stream (all op codes except the reserved A5 with random operands)
+/// and random RAM and SFR contents. The same seed always generates the same program.
+void generate_random_program( Processor &processor, u32 seed );
@@ -0,0 +1,67 @@
+#pragma once
+
+#include "sim8051/stdafx.hpp"
+
+/// Asynchronous logger behind log(). Any thread queues messages into a bounded ring buffer without locking, a
+/// background thread passes them to the sink. So logging never waits for the console or the GUI, and firmware which
+/// triggers a warning in a loop (like an invalid SFR access) neither slows the simulation down nor fills the memory:
+/// debug messages and warnings are limited to rate_limit per second and dropped if the buffer is full (the number of
+/// dropped messages is logged). Info messages and errors wait for space instead.
+class Logger {
+public:
+    using Sink = std::function<void( LogLevel level, const String &message )>;
+
+    static constexpr size_t capacity = 1024; // Messages which can be pending.
+    static constexpr u32 rate_limit = 100; // Debug messages and warnings per second.
+
+    std::atomic<LogLevel> min_level{ LogLevel::debug }; // Less severe messages are ignored.
+
+    /// Starts the thread which passes the messages to the sink (one after another, in the order they were queued).
+    explicit Logger( Sink sink );
+    Logger( const Logger & ) = delete;
+    Logger &operator=( const Logger & ) = delete;
+    /// Passes the pending messages to the sink and stops the thread (and uninstalls the logger, see install()).
+    ~Logger();
+
+    /// Makes this the logger of log() (which writes to std::cerr while no logger is installed).
+    void install();
+
+    /// Queues a message (from any thread).
+    void push( LogLevel level, const String &message );
+    /// Returns whether a message of this level would be queued now. The caller is expected to skip the message
+    /// otherwise, so a message which exceeds the rate limit is counted as dropped.
+    bool accepts( LogLevel level );
+    /// Waits until all messages which were queued before were passed to the sink.
+    void flush();
+
+private:
+    struct Slot {
+        std::atomic<size_t> sequence; // Position which may be written (== position) or read (== position + 1).
+        LogLevel level;
+        String message; // Keeps its capacity, so queueing messages of similar length doesn't allocate.
+    };
+
+    Sink sink;
+    std::array<Slot, capacity> slots;
+    alignas( 64 ) std::atomic<size_t> write_position{ 0 };
+    alignas( 64 ) std::atomic<size_t> read_position{ 0 }; // Only written by the thread.
+    std::atomic<i64> rate_second{ 0 }; // Second of the steady clock which rate_count belongs to.
+    std::atomic<u32> rate_count{ 0 }; // Rate limited messages in this second.
+    std::atomic<size_t> dropped{ 0 }; // Since they were reported last.
+    std::chrono::steady_clock::time_point last_drop_report; // Only used by the thread.
+
+    std::mutex wake_mutex; // Only used to wait for messages (not to queue them).
+    std::condition_variable wake;
+    std::atomic<bool> waiting{ false };
+    std::atomic<bool> stop{ false };
+    std::thread thread; // Started last.
+
+    /// Returns whether messages of this level are rate limited (and may be dropped).
+    static bool is_rate_limited( LogLevel level );
+    /// Returns whether a rate limited message may be queued (and counts it if "take").
+    bool within_rate( bool take );
+    /// Passes all queued messages to the sink (and the number of dropped messages, always if "final").
+    void drain( bool final );
+    /// Main loop of the thread.
+    void run();
+};
@@ -0,0 +1,43 @@
+#pragma once
+
+#include "sim8051/stdafx.hpp"
+
+/// Hex dump of a memory (row_size bytes per row) which tracks the changes between updates, e. g. one update per GUI
+/// frame. Every row has a generation (the update in which it changed last), so the text of unchanged rows is built
+/// only once, and every byte knows when it changed last, so recent changes can be highlighted by age.
+class MemoryView {
+public:
+    static constexpr size_t row_size = 8; // Bytes per row.
+    static constexpr u32 unchanged = ~0u; // Age of bytes which didn't change since the last reset().
+
+    /// Creates a view of a memory with "size" bytes (a multiple of row_size).
+    explicit MemoryView( size_t size );
+
+    /// Takes the content of the memory without recording changes (e. g. after a program was loaded).
+    void reset( const u8 *memory );
+    /// Compares the memory with the last update and records the changed bytes.
+    void update( const u8 *memory );
+
+    size_t row_count() const { return bytes.size() / row_size; }
+
+    /// Returns the text of a row ("Addr 0010:  01 02 ...  |  .."), which is only rebuilt after the row changed.
+    const String &row_text( size_t row );
+    /// Returns the offset of a byte (" 01") in the text of every row. The ASCII part starts at byte_offset( row_size ).
+    size_t byte_offset( size_t column ) const { return 7 + address_digits + 3 * column; }
+
+    /// Returns the number of updates since a byte changed, or "unchanged".
+    u32 byte_age( size_t addr ) const { return age( changed_at[addr] ); }
+    /// Returns the number of updates since any byte of a row changed, or "unchanged".
+    u32 row_age( size_t row ) const { return age( row_generations[row] ); }
+
+private:
+    u8 address_digits; // 2 for memories up to 256 bytes, otherwise 4.
+    u32 update_count = 0; // Updates since the last reset().
+    std::vector<u8> bytes; // Content at the last update.
+    std::vector<u32> changed_at; // Update of the last change of every byte (0 if it didn't change).
+    std::vector<u32> row_generations; // Update of the last change of every row (0 if it didn't change).
+    std::vector<u32> text_generations; // Row generation from which the text was built.
+    std::vector<String> texts; // Empty if not yet built.
+
+    u32 age( u32 generation ) const { return generation == 0 ? unchanged : update_count - generation; }
+};
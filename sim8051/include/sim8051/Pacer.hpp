@@ -0,0 +1,55 @@
+#pragma once
+
+#include "sim8051/stdafx.hpp"
+
+/// Keeps the simulated time in a fixed ratio to the host time (steady clock). The simulated time is derived from the
+/// machine cycle count, so the pace doesn't depend on the instruction mix. Every target time is computed from the start
+/// point, so rounding errors and late wake-ups don't accumulate.
+class Pacer {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    f64 oscillator_hz = 12e6; // Clock of the microcontroller (a machine cycle takes 12 oscillator periods).
+    f64 ratio = 1; // Simulated time per host time (e. g. 0.5 or 10).
+    f64 max_lag = 0.1; // Seconds the simulation may fall behind before pacing restarts (instead of catching up).
+    Clock::duration spin_time = std::chrono::microseconds( 200 ); // Final part of a wait which is spun, not slept.
+
+    // Statistics since start()
+    f64 worst_lag = 0; // Largest time in seconds by which the simulation was behind the host clock.
+    size_t restarts = 0; // How often the simulation fell behind by more than max_lag.
+
+    /// Starts pacing at a cycle count (e. g. when a run starts or the settings were changed). Resets the statistics.
+    void start( size_t cycle_count );
+
+    /// Returns the cycle count the simulation should have reached by now (for loops which can't block, like a GUI).
+    size_t target_cycle() const;
+
+    /// Records the lag at a cycle count (the simulation should be at least at target_cycle()). Restarts pacing if the
+    /// simulation is more than max_lag behind, so that it doesn't run at full speed for a while to catch up.
+    void check_lag( size_t cycle_count );
+
+    /// Blocks until the host time reaches the time of a cycle count (sleeps, then spins for precision).
+    void wait_until( size_t cycle_count );
+
+    /// Waits for the host clock once per millisecond of host time (the cycles of a host millisecond at the current
+    /// ratio). Cheap enough to be called after every instruction.
+    void pace( size_t cycle_count ) {
+        if ( cycle_count >= next_wait_cycle )
+            wait_until( cycle_count );
+    }
+
+    /// Returns the ratio of simulated time to host time which was achieved since start().
+    f64 achieved_ratio( size_t cycle_count ) const;
+
+private:
+    Clock::time_point start_time; // Host time of start_cycle.
+    size_t start_cycle = 0;
+    Clock::time_point stats_time; // Start of the statistics (start_time moves on restarts).
+    size_t stats_cycle = 0;
+    size_t next_wait_cycle = 0; // See pace().
+
+    /// Returns the simulated machine cycles per host second.
+    f64 cycles_per_second() const { return oscillator_hz / 12 * ratio; }
+    /// Returns the host time at which a cycle count is due.
+    Clock::time_point due_time( size_t cycle_count ) const;
+};
@@ -0,0 +1,75 @@
+#pragma once
+
+#include "sim8051/stdafx.hpp"
+#include "sim8051/Bitmap.hpp"
+
+/// Byte array which knows the pages (256 bytes) that were written since it was cleared. All other pages are zero, so
+/// clearing and copying only touch the dirty pages.
+/// Every non-const access marks its page as dirty, so writes can't be missed. Read-only code should access the memory
+/// through a const reference (e. g. std::as_const()) to keep the dirty pages to a minimum.
+template <size_t N>
+struct PagedMemory {
+    static constexpr size_t page_size = 256;
+    static constexpr size_t page_count = N / page_size;
+    static_assert( N % page_size == 0, "The size must be a multiple of the page size" );
+
+    Bitmap<page_count> dirty_pages; // Pages which may contain non-zero bytes.
+    std::array<u8, N> bytes = {};
+
+    PagedMemory() = default;
+    PagedMemory( const PagedMemory &other ) = default;
+
+    /// Copies only the dirty pages of both memories.
+    PagedMemory &operator=( const PagedMemory &other ) {
+        for_each_page( dirty_pages, other.dirty_pages, [&]( size_t offset ) {
+            if ( other.dirty_pages.test( offset / page_size ) )
+                std::copy_n( other.bytes.begin() + offset, page_size, bytes.begin() + offset );
+            else
+                std::fill_n( bytes.begin() + offset, page_size, 0 );
+        } );
+        dirty_pages = other.dirty_pages;
+        return *this;
+    }
+
+    const u8 &operator[]( size_t idx ) const { return bytes[idx]; }
+    u8 &operator[]( size_t idx ) {
+        dirty_pages.set( idx / page_size );
+        return bytes[idx];
+    }
+
+    /// Sets all bytes to zero (only the dirty pages are cleared).
+    void clear() {
+        for_each_page( dirty_pages, dirty_pages,
+                       [&]( size_t offset ) { std::fill_n( bytes.begin() + offset, page_size, 0 ); } );
+        dirty_pages.reset();
+    }
+
+    static constexpr size_t size() { return N; }
+    const u8 *data() const { return bytes.data(); }
+
+    auto begin() const { return bytes.begin(); }
+    auto end() const { return bytes.end(); }
+    /// Mutable iteration marks all pages as dirty.
+    auto begin() {
+        for ( size_t page = 0; page < page_count; page++ )
+            dirty_pages.set( page );
+        return bytes.begin();
+    }
+    auto end() { return bytes.end(); }
+
+    bool operator==( const PagedMemory &other ) const { return bytes == other.bytes; }
+    bool operator!=( const PagedMemory &other ) const { return bytes != other.bytes; }
+
+private:
+    /// Calls "func( offset )" for every page which is dirty in "a" or "b" (whole words of clean pages are skipped).
+    template <typename Func>
+    static void for_each_page( const Bitmap<page_count> &a, const Bitmap<page_count> &b, Func &&func ) {
+        for ( size_t word = 0; word < a.word_count; word++ ) {
+            u64 pages = a.words[word] | b.words[word];
+            for ( size_t bit = 0; pages != 0; bit++, pages >>= 1 ) {
+                if ( pages & 1 )
+                    func( ( word * 64 + bit ) * page_size );
+            }
+        }
+    }
+};
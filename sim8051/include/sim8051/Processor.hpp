@@ -1,6 +1,87 @@
 #pragma once
 
 #include "sim8051/stdafx.hpp"
+#include "sim8051/Coverage.hpp"
+#include "sim8051/Bitmap.hpp"
+#include "sim8051/PagedMemory.hpp"
+#include "sim8051/Condition.hpp"
+#include "sim8051/Instrumentation.hpp"
+#include "sim8051/Serial.hpp"
+#include "sim8051/Anomalies.hpp"
+#include "sim8051/RuntimeStats.hpp"
+
+/// A single access to memory done by an instruction.
+struct MemAccess {
+    MemSpace space;
+    u16 addr;
+    bool write;
+};
+
+/// Optional properties of an execution breakpoint.
+struct BreakpointOptions {
+    String expression; // Source of the condition (for display).
+    Condition condition; // Only break if this is true.
+    size_t ignore_count = 0; // Number of hits (with a true condition) to ignore before breaking.
+    size_t hit_count = 0; // Number of times the breakpoint was reached with a true condition.
+};
+
+/// Execution breakpoints and data watchpoints. Every lookup is a single bitmap test.
+struct Breakpoints {
+    /// Kinds of breakpoints (used as flags).
+    enum Kind : u8 {
+        execute = 1,
+        read = 2,
+        write = 4,
+    };
+
+    Bitmap<64 * 1024> code_execute;
+    Bitmap<64 * 1024> code_read;
+    Bitmap<256> iram_read;
+    Bitmap<256> iram_write;
+    Bitmap<128> sfr_read;
+    Bitmap<128> sfr_write;
+    Bitmap<64 * 1024> xram_read;
+    Bitmap<64 * 1024> xram_write;
+
+    u8 armed = 0; // Kinds of which at least one breakpoint is set.
+
+    std::map<u16, BreakpointOptions> options; // Conditions of execution breakpoints (only checked on a bitmap hit).
+
+    /// Returns whether a breakpoint of a kind is set at the address.
+    bool test( MemSpace space, Kind kind, u16 addr ) const {
+        switch ( space ) {
+        case MemSpace::code:
+            return kind == execute ? code_execute.test( addr ) : kind == read && code_read.test( addr );
+        case MemSpace::iram:
+            return kind == read ? iram_read.test( addr & 0xff ) : kind == write && iram_write.test( addr & 0xff );
+        case MemSpace::sfr:
+            return kind == read ? sfr_read.test( addr & 0x7f ) : kind == write && sfr_write.test( addr & 0x7f );
+        case MemSpace::xram:
+            return kind == read ? xram_read.test( addr ) : kind == write && xram_write.test( addr );
+        }
+        return false;
+    }
+
+    /// Sets or removes a breakpoint. Returns false if the kind is not supported for the address space.
+    bool set( MemSpace space, Kind kind, u16 addr, bool enable );
+
+    /// Sets an execution breakpoint which only breaks if the condition is true, after ignoring the first
+    /// "ignore_count" hits. Returns false if the condition is invalid.
+    bool set_conditional( u16 addr, const String &expression, size_t ignore_count );
+
+    /// Removes all breakpoints and watchpoints.
+    void clear();
+
+    /// Calls "func( space, kind, addr )" for every set breakpoint.
+    void for_each( const std::function<void( MemSpace, Kind, u16 )> &func ) const;
+};
+
+/// Entry of the shadow call stack.
+struct ShadowFrame {
+    u16 return_addr; // Address after the call (or the interrupted instruction).
+    u8 sp; // Stack pointer after the return address was pushed.
+    bool is_interrupt;
+};
 
 /// Holds processor context and does the simulation.
 class Processor {
@@ -14,34 +95,125 @@ class Processor {
     bool is_in_high_prio_intr = false;
     bool was_in_interrupt = false; // One instruction after RETI is always executed (see specifaction):
 
+    enum class StepMode : u8 {
+        none,
+        over, // Until an instruction on the starting call depth was executed.
+        out, // Until the call depth is lower than at the start.
+        run_to, // Until step_target is reached.
+    };
+    StepMode step_mode = StepMode::none;
+    bool step_executed = false; // Whether an instruction on step_depth was executed (for StepMode::over).
+    u16 step_target = 0;
+    size_t step_depth = 0; // Call depth when the step was started.
+
+    /// Simulates one instruction. "tracked" enables reporting of memory accesses (for watchpoints and observers).
+    template <bool tracked>
+    void do_cycle_impl();
+    /// Reports a read access of the current instruction (called before the access).
+    template <bool tracked>
+    void note_read( MemSpace space, u16 addr );
+    /// Reports a write access of the current instruction (called after the access).
+    template <bool tracked>
+    void note_write( MemSpace space, u16 addr );
+    /// Reports an event to the observers.
+    template <bool tracked>
+    void note_event( Event::Kind kind, MemSpace space, u16 addr, u8 value );
+    /// Checks condition and hit count of an execution breakpoint.
+    bool break_here( u16 addr );
+    /// Removes the frames of the shadow stack which are returned from by a RET/RETI at the stack pointer "sp".
+    void shadow_return( u8 sp );
+    /// Returns whether the current step is finished (called after each instruction).
+    bool step_finished() const;
+    /// Starts the transmission of the byte which was written to SBUF.
+    void serial_transmit();
+    /// Advances transmission and reception of the serial port by the time of an instruction.
+    void serial_cycle( u8 cycles, u8 timer1_overflows );
+
 public:
     /// Returns the value at a direct address.
     u8 &direct_acc( u8 addr );
+    /// Returns the value at a direct address (without reporting invalid SFR addresses, e. g. for read-only views).
+    u8 direct_acc( u8 addr ) const { return addr < 0x80 ? iram[addr] : sfr[addr - 0x80]; }
     /// Returns whether bit is set.
     bool is_bit_set( u8 bit_addr );
+    /// Returns whether bit is set (see the const direct_acc()).
+    bool is_bit_set( u8 bit_addr ) const {
+        u8 byte_addr = bit_addr < 0x80 ? 0x20 + ( bit_addr >> 3 ) : bit_addr & 0b11111000;
+        return ( direct_acc( byte_addr ) >> ( bit_addr & 0b111 ) ) & 1;
+    }
     /// Sets or clears a bit.
     void set_bit_to( u8 bit_addr, bool value );
 
     std::array<u8, 128> sfr; // Special Function Registers address space.
     std::array<u8, 256> iram; // Internal RAM.
-    std::array<u8, 64 * 1024> xram; // External RAM.
-    std::array<u8, 64 * 1024> text; // Source code.
+    PagedMemory<64 * 1024> xram; // External RAM.
+    PagedMemory<64 * 1024> text; // Source code.
     u16 pc = 0; // Program Counter.
 
     /// Metadata
     size_t cycle_count = 0;
 
+    // Coverage functionality
+    bool record_coverage = false; // Record executed instructions and branch outcomes into "coverage".
+    Coverage coverage; // Coverage of all runs since the program was loaded.
+
     // Breakpoint functionality
     u8 break_instruction = 0; // Always break on this instruction (could be set to 0xA5 to "disable").
-    std::vector<u16> break_addresses; // Break always on these addresses.
+    Breakpoints breakpoints; // Break on these addresses and data accesses.
+    std::optional<MemAccess> watch_hit; // The access which triggered a watchpoint (only valid in break_callback).
     std::function<void( Processor & )> break_callback = []( auto && ) {}; // Called on a breakpoint.
 
-    /// Load source code from a HEX-file. Returns true on success.
+    // Stepping functionality
+    std::vector<ShadowFrame> shadow_stack; // Active calls and interrupts, innermost last.
+    bool step_completed = false; // Whether a finished step caused the break (only valid in break_callback).
+
+    // Instrumentation functionality
+    Instrumentation instrumentation; // Observers of instruction, memory, interrupt and timer events.
+
+    // Serial port functionality
+    SerialPort serial; // UART state and the frames exchanged with the host.
+
+    // Symbols of the program
+    std::map<u16, String> symbols; // Labels by address (set by compile_assembly(), empty for hex files).
+
+    // Anomaly functionality
+    Anomalies anomalies; // Invalid SFR accesses, divisions by zero and reserved instructions since the last full reset.
+
+    // Statistics functionality
+    RuntimeStats stats; // Instruction mix, interrupts, timer overflows, MOVX and idle time since the last full reset.
+
+    /// Load source code from a HEX-file (see parse_hex_image()) or a raw binary image (".bin" extension, loaded from
+    /// address 0). The file is memory mapped. Returns true on success.
     bool load_hex_code( const String &file );
+    /// Load source code in HEX format from a stream. Returns true on success.
+    bool load_hex_code( std::istream &stream );
+    /// Load machine code from address 0 (e. g. the output of the Assembler) and clear the symbols. Returns false if it
+    /// doesn't fit into code memory.
+    bool load_code( const std::vector<u8> &code );
+
+    /// Evaluates a condition on the current state.
+    bool evaluate( const Condition &condition );
+
+    /// Starts a step over the next instruction, i. e. runs until the next instruction on the current call depth. Calls
+    /// and interrupts are executed completely. break_callback is called when the step is finished.
+    void step_over();
+    /// Starts running until the current subroutine or interrupt returned. Returns false if there is none.
+    bool step_out();
+    /// Starts running until the instruction at "addr" is reached.
+    void run_to( u16 addr );
+    /// Stops the current step (without calling break_callback).
+    void cancel_step() { step_mode = StepMode::none; }
+    /// Returns whether a step is in progress.
+    bool is_stepping() const { return step_mode != StepMode::none; }
 
     /// Resets all state (except ram and text/code).
     void reset();
 
+    /// Copies the simulation state (registers, memories, interrupt, timer and serial port state, cycle count, shadow
+    /// stack, anomalies and statistics) of another processor. Only the dirty pages of the memories are copied.
+    /// Breakpoints, coverage, callbacks and observers stay unchanged and a running step is cancelled.
+    void restore( const Processor &snapshot );
+
     /// Resets all state (except text/code).
     void full_reset();
 
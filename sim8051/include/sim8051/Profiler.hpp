@@ -0,0 +1,168 @@
+#pragma once
+
+#include "sim8051/stdafx.hpp"
+
+#include <memory>
+#include <mutex>
+
+#if defined( _MSC_VER ) && ( defined( _M_X64 ) || defined( _M_IX86 ) )
+#include <intrin.h>
+#define SIM8051_HAS_TSC
+#elif ( defined( __GNUC__ ) || defined( __clang__ ) ) && ( defined( __x86_64__ ) || defined( __i386__ ) )
+#include <x86intrin.h>
+#define SIM8051_HAS_TSC
+#endif
+
+/// Phases of the simulator which are timed by profiling zones.
+enum class Zone : u8 {
+    interrupts, // do_cycle(): interrupt detection and entry (the preamble of every instruction).
+    dispatch, // do_cycle(): decoding and executing the instruction.
+    timers, // do_cycle(): timers 0 and 1.
+    serial, // do_cycle(): serial port.
+    breakpoints, // do_cycle(): breakpoint and step checks.
+    frame, // GUI: a whole frame.
+    frame_sync, // GUI: taking the snapshot and updating the code map and memory views.
+    frame_events, // GUI: event handling.
+    frame_windows, // GUI: building (and formatting the text of) the windows.
+    frame_render, // GUI: rendering.
+    count, // Number of zones.
+};
+
+/// Returns the name of a zone (e. g. for the trace).
+const char *zone_name( Zone zone );
+
+/// Time spent in a zone (in ticks, see Profiler::ticks_per_second()).
+struct ZoneTotals {
+    u64 calls = 0;
+    u64 ticks = 0;
+    u64 max_ticks = 0; // Of a single call.
+};
+
+/// Collects the time spent in the zones of all threads and optionally records every call for a trace.
+/// Zones are only compiled in if SIM8051_PROFILING is defined, which CMake does for debug builds (option
+/// SIM8051_PROFILING). Otherwise ProfileZone does nothing and the profiler stays empty. Even then zones are only timed
+/// while the profiler is active, so an idle profiler costs a flag check per zone.
+class Profiler {
+public:
+#ifdef SIM8051_PROFILING
+    static constexpr bool enabled = true;
+#else
+    static constexpr bool enabled = false;
+#endif
+    static constexpr size_t trace_capacity = 1 << 20; // Calls recorded by a trace (later ones are left out).
+
+    Profiler();
+    Profiler( const Profiler & ) = delete;
+    Profiler &operator=( const Profiler & ) = delete;
+
+    /// Returns the current time in ticks (of the time stamp counter where available, else of the steady clock).
+    static u64 now() {
+#ifdef SIM8051_HAS_TSC
+        return __rdtsc();
+#else
+        return std::chrono::steady_clock::now().time_since_epoch().count();
+#endif
+    }
+    /// Returns the number of ticks per second (the time stamp counter is measured against the steady clock).
+    f64 ticks_per_second() const;
+
+    /// Starts or stops timing the zones (the totals are kept).
+    void set_active( bool value ) { active.store( value, std::memory_order_relaxed ); }
+    bool is_active() const { return active.load( std::memory_order_relaxed ); }
+
+    /// Adds a call of a zone (from any thread).
+    void add( Zone zone, u64 start, u64 end );
+    /// Returns the time spent in a zone since the last reset (of all threads).
+    ZoneTotals totals( Zone zone ) const;
+    /// Clears the totals of all zones.
+    void reset();
+
+    /// Activates the profiler and starts recording the calls of all zones (until trace_capacity calls were recorded).
+    void start_trace();
+    bool is_tracing() const { return tracing.load( std::memory_order_relaxed ); }
+    /// Returns the number of recorded calls (of the running or the last trace).
+    size_t trace_size() const {
+        return is_tracing() ? std::min<size_t>( trace_claimed.load( std::memory_order_relaxed ), trace_capacity )
+                            : trace_written;
+    }
+    /// Stops recording and writes the recorded calls in the Chrome trace event format (for chrome://tracing or
+    /// Perfetto). Must be called from one thread at a time. Returns false if nothing was recorded.
+    bool write_trace( std::ostream &output );
+
+private:
+    /// Counters of one thread. Only the thread itself writes them (without read-modify-write operations), the atomics
+    /// just make the merging reads well-defined. They are aligned to cache lines, so threads don't share any.
+    struct alignas( 64 ) ThreadCounters {
+        struct Counters {
+            std::atomic<u64> calls{ 0 };
+            std::atomic<u64> ticks{ 0 };
+            std::atomic<u64> max_ticks{ 0 };
+        };
+        std::array<Counters, static_cast<size_t>( Zone::count )> counters;
+        std::atomic<u64> epoch{ 0 }; // Of the last reset which the thread saw (older counters are ignored).
+    };
+    struct TraceEvent {
+        u64 start;
+        u64 end;
+        u32 thread;
+        std::atomic<u8> zone{ 0 }; // Zone + 1, set last (0 while the event is written).
+    };
+
+    /// Returns the counters of the calling thread (registered by its first call).
+    ThreadCounters &thread_counters();
+
+    mutable std::mutex threads_mutex;
+    std::vector<std::unique_ptr<ThreadCounters>> threads; // Of all threads which added calls (also finished ones).
+    std::atomic<u64> epoch{ 0 }; // Incremented by reset().
+    std::atomic<bool> active{ false };
+    std::unique_ptr<TraceEvent[]> trace; // Allocated by the first trace.
+    std::atomic<u64> trace_claimed{ 0 }; // Events which were claimed by writers (may exceed trace_capacity).
+    std::atomic<bool> tracing{ false };
+    size_t trace_written = 0; // Events of the last trace (set when it's stopped).
+    u64 start_ticks; // Time of the construction (to measure the tick rate).
+    std::chrono::steady_clock::time_point start_time;
+};
+
+/// The profiler of all zones.
+extern Profiler profiler;
+
+#ifdef SIM8051_PROFILING
+
+/// Times a scope (a phase of the simulator) if the profiler is active. next() ends the current zone and starts another
+/// one, so consecutive phases of a function only take one time stamp each.
+class ProfileZone {
+public:
+    explicit ProfileZone( Zone zone )
+        : zone( zone ), active( profiler.is_active() ), start( active ? Profiler::now() : 0 ) {}
+    ProfileZone( const ProfileZone & ) = delete;
+    ProfileZone &operator=( const ProfileZone & ) = delete;
+    ~ProfileZone() {
+        if ( active )
+            profiler.add( zone, start, Profiler::now() );
+    }
+
+    void next( Zone next_zone ) {
+        if ( active ) {
+            u64 time = Profiler::now();
+            profiler.add( zone, start, time );
+            start = time;
+        }
+        zone = next_zone;
+    }
+
+private:
+    Zone zone;
+    bool active; // The profiler was active when the zone started.
+    u64 start;
+};
+
+#else
+
+/// Compiled out (see Profiler).
+class ProfileZone {
+public:
+    explicit ProfileZone( Zone ) {}
+    void next( Zone ) {}
+};
+
+#endif
@@ -0,0 +1,37 @@
+#pragma once
+
+#include "sim8051/stdafx.hpp"
+
+/// Counters of what the firmware did since they were cleared (e. g. to spot performance regressions of the firmware
+/// from build to build). The processor updates them while executing: one increment per instruction for the op code
+/// mix, the other counters only change on their (rare) events.
+struct RuntimeStats {
+    static constexpr std::array<u16, 5> interrupt_vectors = { 0x03, 0x0B, 0x13, 0x1B, 0x23 };
+    static constexpr std::array<const char *, 5> interrupt_names = { "ex0", "timer0", "ex1", "timer1", "serial" };
+
+    std::array<u64, 256> opcodes = {}; // Executed instructions by op code.
+    std::array<u64, 5> interrupts = {}; // Taken interrupts by vector (in the order of interrupt_vectors).
+    std::array<u64, 2> timer_overflows = {}; // By timer (also without a flag, like TL0 in mode 3).
+    u64 movx_reads = 0;
+    u64 movx_writes = 0;
+    u64 idle_cycles = 0; // Cycles in idle mode (PCON.0).
+    u64 power_down_steps = 0; // Calls of do_cycle() in power down mode (PCON.1), which don't advance the cycle count.
+    u64 start_cycle = 0; // Cycle count when the counters were cleared.
+    f64 host_seconds = 0; // Host time spent simulating (added by the code which runs the processor).
+
+    /// Counts a taken interrupt.
+    void count_interrupt( u16 vector ) {
+        // The vectors are 8 bytes apart.
+        interrupts[std::min<size_t>( vector >> 3, interrupts.size() - 1 )]++;
+    }
+
+    /// Returns the number of executed instructions.
+    u64 instructions() const;
+
+    /// Resets all counters (the cycle count of the processor is the start of the simulated time).
+    void clear( u64 cycle_count );
+
+    /// Writes the counters as a JSON object (indented by "indent" spaces). The simulated time is measured up to
+    /// "cycle_count"; op codes and mnemonics which were not executed are left out.
+    void write_json( std::ostream &output, u64 cycle_count, size_t indent = 0 ) const;
+};
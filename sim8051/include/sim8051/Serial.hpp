@@ -0,0 +1,68 @@
+#pragma once
+
+#include "sim8051/stdafx.hpp"
+
+class Processor;
+
+/// Serial port (UART) of the processor. Frames are simulated as a whole: a transmission or reception takes the time of
+/// all its bits (derived from the oscillator or timer 1, depending on the mode) and then completes at once.
+struct SerialPort {
+    /// Called with every transmitted frame: the data byte and the 9th data bit (TB8, only modes 2 and 3).
+    std::function<void( u8 byte, bool bit8 )> transmit;
+    /// Frames which arrive at RXD, oldest first: data byte in bits 0-7 and the 9th data bit (modes 2 and 3) or the
+    /// stop bit (mode 1) in bit 8.
+    std::deque<u16> input;
+
+    // Simulation state
+    u8 receive_buffer = 0; // SBUF as read by the program (the SFR SBUF always holds this value).
+    u16 transmit_frame = 0; // Frame which is being sent.
+    u32 transmit_ticks = 0; // Remaining time of the transmission (0 if idle).
+    u16 receive_frame = 0; // Frame which is being received.
+    u32 receive_ticks = 0; // Remaining time of the reception (0 if idle).
+
+    /// Returns the duration of a frame in ticks for the values of SCON and PCON. A tick is one oscillator period in
+    /// modes 0 and 2 and one overflow of timer 1 in modes 1 and 3.
+    static u32 frame_ticks( u8 scon, u8 pcon );
+
+    /// Resets the simulation state (the input queue is kept).
+    void reset();
+
+    /// Copies the simulation state of another serial port (the input queue and the callback are kept).
+    void restore( const SerialPort &snapshot );
+};
+
+/// Connects the serial port to a pseudo-terminal or to files and pipes of the host (only available on POSIX systems).
+class SerialBridge {
+    int input_fd = -1;
+    int output_fd = -1;
+    bool close_input = false; // Whether input_fd is closed by the destructor.
+    bool close_output = false;
+    bool input_finished = false; // End of the input file was reached.
+    String output_buffer; // Transmitted bytes which weren't written yet.
+
+public:
+    static constexpr size_t max_queued_input = 4096; // Frames which are read in advance into SerialPort::input.
+
+    SerialBridge() = default;
+    SerialBridge( const SerialBridge & ) = delete;
+    SerialBridge &operator=( const SerialBridge & ) = delete;
+    ~SerialBridge();
+
+    /// Creates a pseudo-terminal for host tools. Returns the name of the device to open (like "/dev/pts/3") or an
+    /// empty string on failure.
+    String open_pty();
+
+    /// Reads received bytes from a file or pipe and writes transmitted bytes to another one ("-" means stdin or stdout,
+    /// an empty name disables the direction). Returns true on success.
+    bool open_files( const String &input, const String &output );
+
+    /// Sends the transmitted frames of the processor to the host.
+    void attach( Processor &processor );
+
+    /// Moves available host data into the input queue of the processor and writes pending output. Should be called
+    /// regularly (e. g. every few hundred instructions).
+    void poll( Processor &processor );
+
+    /// Returns whether the end of the input file was reached.
+    bool input_at_end() const { return input_finished; }
+};
@@ -0,0 +1,91 @@
+#pragma once
+
+#include "sim8051/stdafx.hpp"
+#include "sim8051/Processor.hpp"
+#include "sim8051/Pacer.hpp"
+#include "sim8051/SpscQueue.hpp"
+
+/// Runs a processor on its own thread, so that the simulation speed doesn't depend on the frame rate of a GUI and the
+/// GUI stays responsive during long runs. One control thread sends commands, which are executed in order between two
+/// instructions, and reads snapshots of the state. Neither side locks.
+class Simulation {
+public:
+    enum class Mode : u8 {
+        paused, // Only commands and steps (over, out, to cursor) are executed.
+        animated, // Runs animation_rate instructions per second.
+        max_speed,
+        real_time, // Paced by the host clock (see set_pacing()).
+    };
+
+    /// Consistent state of the processor and the simulation at one point in time.
+    struct Snapshot {
+        Processor processor; // State, breakpoints, coverage and symbols (callbacks and observers are not copied).
+        Mode mode = Mode::paused;
+        bool stepping = false; // A step (over, out, to cursor) is in progress.
+        size_t program_version = 0; // Incremented when a program was loaded.
+        size_t symbols_version = 0; // Incremented when the symbols changed (they are only copied then).
+        f64 real_time_ratio = 0; // Achieved ratio since real time mode started.
+        f64 worst_lag = 0; // Largest lag in seconds in real time mode.
+    };
+
+    using Command = std::function<void( Processor & )>;
+
+    static constexpr size_t queue_size = 256; // Commands which can be pending.
+    static constexpr size_t slice_size = 1024; // Instructions between checks for commands and snapshot requests.
+    static constexpr f64 animation_rate = 60;
+
+    /// Starts the simulation thread (paused).
+    Simulation();
+    Simulation( const Simulation & ) = delete;
+    Simulation &operator=( const Simulation & ) = delete;
+    /// Stops the simulation thread.
+    ~Simulation();
+
+    /// Executes a function with the processor on the simulation thread (e. g. to change memory or breakpoints).
+    void execute( Command command );
+    /// Changes the run mode.
+    void set_mode( Mode mode );
+    /// Sets the speed of real time mode: "ratio" times as fast as a microcontroller with the given clock.
+    void set_pacing( f64 ratio, f64 oscillator_hz );
+    /// Pauses and loads a hex file (the result is logged).
+    void load( const String &file );
+    /// Pauses and loads machine code and its labels (e. g. from the Assembler, without a hex file).
+    void load( std::vector<u8> code, std::map<u16, String> symbols );
+    /// Overwrites code memory from "addr" and replaces the labels without stopping or resetting the program (e. g. to
+    /// apply an edit).
+    void patch( size_t addr, std::vector<u8> bytes, std::map<u16, String> symbols );
+
+    /// Returns the latest published snapshot and requests the next one. The snapshot stays valid and unchanged until
+    /// the next call. Must always be called from the same (control) thread.
+    const Snapshot &snapshot();
+
+private:
+    static constexpr u8 fresh_snapshot = 0x80; // Flag of middle_snapshot: not yet taken by the control thread.
+
+    // State of the simulation thread
+    Processor processor;
+    Mode mode = Mode::paused;
+    Pacer pacer;
+    size_t program_version = 0;
+    size_t symbols_version = 0;
+
+    SpscQueue<std::function<void()>, queue_size> commands;
+
+    // Triple buffer: the simulation thread writes the back buffer and swaps it with the middle one, the control thread
+    // swaps the middle buffer with the front one when it's fresh.
+    std::array<Snapshot, 3> snapshots;
+    u8 back_snapshot = 0;
+    u8 front_snapshot = 1;
+    std::atomic<u8> middle_snapshot{ 2 };
+    std::atomic<bool> snapshot_requested{ true };
+
+    std::atomic<bool> stop{ false };
+    std::thread thread; // Started last.
+
+    /// Queues a function for the simulation thread (waits while the queue is full).
+    void send( std::function<void()> &&function );
+    /// Copies the state into the back buffer and publishes it.
+    void publish();
+    /// Main loop of the simulation thread.
+    void run();
+};
@@ -0,0 +1,35 @@
+#pragma once
+
+#include "sim8051/stdafx.hpp"
+
+/// Fixed-size queue for exactly one producer and one consumer thread. Neither side locks or waits.
+template <typename T, size_t N>
+class SpscQueue {
+    static_assert( N != 0 && ( N & ( N - 1 ) ) == 0, "The size must be a power of two" );
+
+    std::array<T, N> items;
+    alignas( 64 ) std::atomic<size_t> head{ 0 }; // Index of the next item to pop (written by the consumer).
+    alignas( 64 ) std::atomic<size_t> tail{ 0 }; // Index of the next free slot (written by the producer).
+
+public:
+    /// Appends an item (producer only). Returns false if the queue is full.
+    bool push( T &&item ) {
+        size_t index = tail.load( std::memory_order_relaxed );
+        if ( index - head.load( std::memory_order_acquire ) == N )
+            return false;
+        items[index % N] = std::move( item );
+        tail.store( index + 1, std::memory_order_release );
+        return true;
+    }
+
+    /// Removes the oldest item (consumer only). Returns false if the queue is empty.
+    bool pop( T &item ) {
+        size_t index = head.load( std::memory_order_relaxed );
+        if ( index == tail.load( std::memory_order_acquire ) )
+            return false;
+        item = std::move( items[index % N] );
+        items[index % N] = T(); // Release resources of the moved-from item early.
+        head.store( index + 1, std::memory_order_release );
+        return true;
+    }
+};
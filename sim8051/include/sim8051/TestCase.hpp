@@ -0,0 +1,75 @@
+#pragma once
+
+#include "sim8051/stdafx.hpp"
+#include "sim8051/Processor.hpp"
+
+/// Bytes at a memory location (expected final content or a stimulus).
+struct MemoryRange {
+    String label; // As written in the test file (for messages).
+    MemSpace space;
+    u16 addr; // Address of the first byte (registers R0-R7 are resolved with the current register bank).
+    bool is_register = false; // "addr" is the number of a register in the current bank.
+    std::vector<u8> bytes;
+};
+
+/// Memory written while the program runs (e. g. to change input pins).
+struct Stimulus {
+    size_t cycle; // Applied before the first instruction which starts at or after this cycle.
+    MemoryRange write;
+};
+
+/// A program together with its expected final state (see load_test_case() for the file format).
+struct TestCase {
+    String name;
+    String program; // Path of the hex or assembly file.
+    size_t max_cycles = 1000000; // The test fails if the program doesn't halt within this budget.
+    std::optional<size_t> cycles; // Expected cycle count when the program halted.
+    std::optional<u16> pc; // Expected program counter when the program halted.
+    std::vector<Stimulus> stimuli; // Sorted by cycle.
+    std::vector<u8> serial_input; // Bytes which arrive at the serial port (queued at the start).
+    std::optional<std::vector<u8>> serial_output; // Expected bytes sent by the serial port.
+    std::vector<MemoryRange> expectations;
+};
+
+/// Outcome of a test case.
+struct TestResult {
+    String name;
+    String failure; // Description of all mismatches (empty if the test passed).
+    bool error = false; // The test couldn't be run (invalid test file or program).
+    size_t cycles = 0;
+    f64 seconds = 0;
+};
+
+/// Loads a test description. Every line contains one entry, ";" starts a comment. Numbers are hexadecimal, except for
+/// cycle counts:
+///   program <file>               Program to run, ".a51" files are assembled (relative to the test file; default:
+///                                same name with ".hex").
+///   max_cycles <N>               Cycle budget (default 1000000).
+///   cycles <N>                   Exact cycle count when the program halted.
+///   pc <addr>                    Program counter when the program halted.
+///   iram <addr> <byte>...        Internal RAM content starting at "addr".
+///   xram <addr> <byte>...        External RAM content starting at "addr".
+///   <register> <byte>            SFR (like A, B, PSW or SP) or R0-R7 of the final register bank.
+///   at <N> <location> <byte>...  Writes to a location (in the syntax above) at cycle N, e. g. "at 100 p3 fb".
+///   serial_in <byte>...          Bytes which are received by the serial port (one after another from the start).
+///   serial_out <byte>...         All bytes which were sent by the serial port.
+/// A program halts when it reaches a jump to itself ("sjmp fe").
+/// Returns true on success.
+bool load_test_case( const String &file, TestCase &test );
+
+/// Loads a hex file or assembles and loads an assembly file (".a51"). Returns true on success.
+bool load_program( const String &file, Processor &processor );
+
+/// Returns whether the instruction at the program counter is a jump to itself.
+bool is_halted( const Processor &processor );
+
+/// Runs until the program halts or the cycle budget is used up and applies the stimuli of the test on the way. The
+/// bytes sent by the serial port are stored in "serial_output". Returns true if the program halted.
+bool run_test_case( const TestCase &test, Processor &processor, std::vector<u8> &serial_output );
+
+/// Compares the state of a halted program with the expectations. Returns a description of all mismatches (one per
+/// line, empty if the test passed).
+String check_test_case( const TestCase &test, const Processor &processor, const std::vector<u8> &serial_output );
+
+/// Writes results as JUnit XML report (one test suite).
+void write_junit( std::ostream &output, const String &suite_name, const std::vector<TestResult> &results );
@@ -2,15 +2,27 @@
 
 #include <iostream>
 #include <string>
+#include <string_view>
+#include <utility>
 #include <vector>
 #include <deque>
 #include <map>
+#include <unordered_map>
+#include <optional>
 #include <array>
+#include <bitset>
 #include <sstream>
+#include <iomanip>
 #include <functional>
 #include <fstream>
 #include <filesystem>
 #include <algorithm>
+#include <chrono>
+#include <random>
+#include <thread>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
 
 using size_t = std::size_t;
 
@@ -39,5 +51,17 @@ using std::stoul;
 using std::stoull;
 using std::to_string;
 
-// Log a message
+// Severity of a log message
+enum class LogLevel : u8 {
+    debug,
+    info,
+    warning,
+    error,
+    off, // Only as minimum level: nothing is logged.
+};
+
+// Log a message (info level without a level, see Logger.hpp)
 void log( const String &str );
+void log( LogLevel level, const String &str );
+// Returns whether a message of this level would be logged now (so hot paths can skip formatting it)
+bool log_enabled( LogLevel level );
@@ -0,0 +1,37 @@
+#include "sim8051/stdafx.hpp"
+#include "sim8051/Anomalies.hpp"
+
+const char *anomaly_name( Anomaly kind ) {
+    switch ( kind ) {
+    case Anomaly::invalid_sfr:
+        return "invalid_sfr";
+    case Anomaly::division_by_zero:
+        return "division_by_zero";
+    case Anomaly::reserved_instruction:
+        return "reserved_instruction";
+    case Anomaly::count:
+        break;
+    }
+    return "unknown";
+}
+
+u64 Anomalies::total() const {
+    u64 sum = 0;
+    for ( auto &counter : counters )
+        sum += counter.count;
+    return sum;
+}
+
+void Anomalies::write_json( std::ostream &output, size_t indent ) const {
+    String space( indent, ' ' );
+    output << "{\n";
+    for ( size_t i = 0; i < counters.size(); i++ ) {
+        auto &c = counters[i];
+        // One kind per line, like the benchmark results.
+        output << space << "  \"" << anomaly_name( static_cast<Anomaly>( i ) ) << "\": { \"count\": " << c.count
+               << ", \"first_pc\": " << c.first_pc << ", \"first_cycle\": " << c.first_cycle
+               << ", \"last_pc\": " << c.last_pc << ", \"last_cycle\": " << c.last_cycle << " }"
+               << ( i + 1 < counters.size() ? "," : "" ) << '\n';
+    }
+    output << space << "}";
+}
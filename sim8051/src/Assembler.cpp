@@ -0,0 +1,723 @@
+#include "sim8051/stdafx.hpp"
+#include "sim8051/Assembler.hpp"
+#include "sim8051/Encoding.hpp"
+#include "sim8051/InstructionSet.hpp"
+
+/// Packs a word of up to 8 characters (in lower case) into a number, so words are compared and hashed as numbers.
+/// Returns 0 for longer words, which are never names.
+constexpr u64 pack_word( std::string_view word ) {
+    if ( word.size() > 8 )
+        return 0;
+    u64 key = 0;
+    for ( size_t i = 0; i < word.size(); i++ ) {
+        char c = word[i] >= 'A' && word[i] <= 'Z' ? word[i] - 'A' + 'a' : word[i];
+        key |= static_cast<u64>( static_cast<u8>( c ) ) << ( 8 * i );
+    }
+    return key;
+}
+
+/// Class of names which are no operand (like "psw") and of arguments which weren't substituted yet. Never part of a
+/// signature.
+constexpr u8 no_operand = 31;
+constexpr u8 no_mnemonic = 0xff;
+
+/// Name of the assembler syntax. One word can be several kinds of names, like "c" (register and bit address).
+struct Word {
+    u64 key = 0; // 0 for unused slots.
+    u8 mnemonic = no_mnemonic;
+    u8 operand = no_operand; // Register ("(r0)" is @R0).
+    bool is_name = false; // Register or SFR name.
+    bool is_sfr = false;
+    u8 sfr = 0; // Address of an SFR or bit name.
+};
+
+/// Registers as written in the assembler syntax (indirect addressing in parenthesis). "(pc)" is a name, but no operand
+/// of any instruction.
+constexpr std::pair<const char *, Operand> register_words[] = {
+    { "a", Operand::a },
+    { "b", Operand::b },
+    { "c", Operand::c },
+    { "dptr", Operand::dptr },
+    { "r0", Operand::r0 },
+    { "r1", Operand::r1 },
+    { "r2", Operand::r2 },
+    { "r3", Operand::r3 },
+    { "r4", Operand::r4 },
+    { "r5", Operand::r5 },
+    { "r6", Operand::r6 },
+    { "r7", Operand::r7 },
+    { "(r0)", Operand::at_r0 },
+    { "(r1)", Operand::at_r1 },
+    { "(dptr)", Operand::at_dptr },
+    { "(a+dptr)", Operand::at_a_dptr },
+    { "(a+pc)", Operand::at_a_pc },
+    { "(pc)", Operand::none },
+};
+
+// The multipliers of the perfect hashes were found by trying random odd numbers until no two keys share a slot.
+constexpr u64 word_multiplier = 0xB47EE9AE9E12066F;
+constexpr size_t word_bits = 8;
+
+constexpr size_t word_slot( u64 key ) {
+    return ( key * word_multiplier ) >> ( 64 - word_bits );
+}
+
+struct WordTable {
+    std::array<Word, 1 << word_bits> slots;
+    bool perfect = true;
+};
+
+constexpr Word &insert_word( WordTable &table, const char *name ) {
+    u64 key = pack_word( name );
+    auto &word = table.slots[word_slot( key )];
+    if ( word.key != 0 && word.key != key )
+        table.perfect = false;
+    word.key = key;
+    return word;
+}
+
+constexpr WordTable make_word_table() {
+    WordTable table;
+    for ( size_t i = 0; i < std::size( mnemonic_names ); i++ )
+        insert_word( table, mnemonic_names[i] ).mnemonic = i;
+    for ( auto &reg : register_words ) {
+        auto &word = insert_word( table, reg.first );
+        word.is_name = true;
+        word.operand = reg.second == Operand::none ? no_operand : static_cast<u8>( reg.second );
+    }
+    for ( auto &symbol : sfr_symbols ) {
+        auto &word = insert_word( table, symbol.name );
+        word.is_name = true;
+        word.is_sfr = true;
+        word.sfr = symbol.addr;
+    }
+    return table;
+}
+
+constexpr WordTable word_table = make_word_table();
+static_assert( word_table.perfect, "Two words share a slot, choose another word_multiplier" );
+
+/// Returns the word of a token or nullptr.
+const Word *find_word( std::string_view token ) {
+    u64 key = pack_word( token );
+    auto &word = word_table.slots[word_slot( key )];
+    return key != 0 && word.key == key ? &word : nullptr;
+}
+
+/// Returns the class of an operand in the signatures of the assembler syntax, where all addresses (direct, bit and
+/// code addresses and offsets) are written as "addr" and all immediate values as "imm".
+constexpr u8 operand_class( Operand operand ) {
+    switch ( operand ) {
+    case Operand::addr16:
+    case Operand::addr11:
+    case Operand::direct:
+    case Operand::offset:
+    case Operand::bit:
+        return static_cast<u8>( Operand::direct );
+    case Operand::immediate16:
+        return static_cast<u8>( Operand::immediate );
+    default:
+        return static_cast<u8>( operand );
+    }
+}
+
+/// Packs a mnemonic and the classes of three operands into a key.
+constexpr u32 signature( u8 mnemonic, u8 first, u8 second, u8 third ) {
+    return mnemonic | first << 6 | second << 11 | third << 16;
+}
+
+constexpr u32 opcode_signature( u8 opcode ) {
+    auto &info = instruction_set[opcode];
+    return signature( static_cast<u8>( info.mnemonic ), operand_class( info.operands[0] ),
+                      operand_class( info.operands[1] ), operand_class( info.operands[2] ) );
+}
+
+constexpr u64 signature_multiplier = 0xF6D9960DC29F123B;
+constexpr size_t signature_bits = 11;
+
+constexpr size_t signature_slot( u32 key ) {
+    return ( key * signature_multiplier ) >> ( 64 - signature_bits );
+}
+
+struct SignatureTable {
+    std::array<u8, 1 << signature_bits> opcodes = {}; // Unused slots are checked like any other.
+    bool perfect = true;
+};
+
+constexpr SignatureTable make_signature_table() {
+    SignatureTable table;
+    std::array<bool, 1 << signature_bits> used = {};
+    for ( size_t opcode = 0; opcode < instruction_set.size(); opcode++ ) {
+        size_t slot = signature_slot( opcode_signature( opcode ) );
+        // The 8 op codes of AJMP and ACALL have the same signature, the last one is taken (the page is patched in).
+        if ( used[slot] && opcode_signature( table.opcodes[slot] ) != opcode_signature( opcode ) )
+            table.perfect = false;
+        used[slot] = true;
+        table.opcodes[slot] = opcode;
+    }
+    return table;
+}
+
+constexpr SignatureTable signature_table = make_signature_table();
+static_assert( signature_table.perfect, "Two signatures share a slot, choose another signature_multiplier" );
+
+/// Returns the op code of a signature or -1.
+i32 find_opcode( u32 key ) {
+    u8 opcode = signature_table.opcodes[signature_slot( key )];
+    return opcode_signature( opcode ) == key ? opcode : -1;
+}
+
+bool is_hex_number( std::string_view text ) {
+    return text.find_first_not_of( "0123456789abcdef" ) == text.npos;
+}
+
+/// Returns the value of a hexadecimal digit or -1.
+i32 hex_digit( char c ) {
+    if ( c >= '0' && c <= '9' )
+        return c - '0';
+    if ( c >= 'a' && c <= 'f' )
+        return c - 'a' + 10;
+    if ( c >= 'A' && c <= 'F' )
+        return c - 'A' + 10;
+    return -1;
+}
+
+/// Returns whether a number is written differently than its encoded byte (e. g. with more digits than fit).
+bool is_misinterpreted( std::string_view text, i32 number ) {
+    auto value = static_cast<i8>( number );
+    u8 bits = text.size() * 4;
+    return text != to_hex_str( static_cast<u16>( value ), bits ) &&
+           text != to_hex_str( static_cast<u8>( value ), bits );
+}
+
+/// Argument of an instruction while its signature is searched.
+struct Argument {
+    enum State : u8 {
+        empty,
+        name, // Register or SFR, "operand" is the register (or no_operand).
+        raw, // Number, label or address in parenthesis.
+        placeholder, // "operand" is direct ("addr"), not_bit ("/addr") or immediate ("imm").
+    };
+
+    std::string_view text; // As written.
+    State state = empty;
+    u8 operand = static_cast<u8>( Operand::none );
+    bool indirect = false; // In parenthesis.
+    bool negated = false; // Starts with "/".
+    bool number = false; // Only hexadecimal digits.
+
+    explicit Argument( std::string_view text ) : text( text ) {
+        if ( text.empty() )
+            return;
+        u64 key = pack_word( text );
+        auto word = find_word( text );
+        if ( key == pack_word( "addr" ) ) {
+            state = placeholder;
+            operand = static_cast<u8>( Operand::direct );
+        } else if ( key == pack_word( "imm" ) ) {
+            state = placeholder;
+            operand = static_cast<u8>( Operand::immediate );
+        } else if ( word && word->is_name ) {
+            state = name;
+            operand = word->operand;
+        } else {
+            state = raw;
+            indirect = text[0] == '(';
+            negated = text[0] == '/';
+            number = is_hex_number( text );
+        }
+    }
+
+    /// Returns the class of the argument in the signature.
+    u8 signature_class() const { return state == raw ? no_operand : operand; }
+    /// "addr" and "imm" are final, "/addr" is substituted again like the original text.
+    bool is_final() const { return state == placeholder && operand != static_cast<u8>( Operand::not_bit ); }
+    bool is_substitutable() const { return state == raw || ( state == placeholder && !is_final() ); }
+
+    void substitute( Operand placeholder_operand ) {
+        state = placeholder;
+        operand = static_cast<u8>( placeholder_operand );
+        indirect = false;
+        number = false;
+        negated = placeholder_operand == Operand::not_bit;
+    }
+};
+
+/// One step of the substitution of arguments by placeholders, which is repeated until a signature matches. First
+/// numbers, labels and addresses in parenthesis are substituted, then names (the second argument first). So e. g.
+/// "mov b 01" becomes "mov addr imm", which is the signature of MOV direct, #immed.
+void substitute_arguments( Argument &first, Argument &second, bool cjne, bool mov ) {
+    bool found = false;
+    if ( first.is_substitutable() ) {
+        // Only CJNE has an immediate value as first argument (the register isn't an argument here).
+        if ( cjne && !first.indirect && first.number )
+            first.substitute( Operand::immediate );
+        else
+            first.substitute( first.negated ? Operand::not_bit : Operand::direct );
+        found = true;
+    }
+    if ( second.is_substitutable() ) {
+        // Labels are addresses, except for MOV DPTR, #data16.
+        bool mov_dptr = mov && first.state == Argument::name && first.operand == static_cast<u8>( Operand::dptr );
+        if ( second.indirect || ( !second.number && !mov_dptr ) )
+            second.substitute( second.negated ? Operand::not_bit : Operand::direct );
+        else
+            second.substitute( Operand::immediate );
+        found = true;
+    }
+    if ( found )
+        return;
+
+    // MOV bit, C is found by substituting the first argument.
+    bool mov_to_c = mov && !first.is_final() && second.state == Argument::name &&
+                    second.operand == static_cast<u8>( Operand::c );
+    if ( !mov_to_c && second.state != Argument::empty && !second.is_final() ) {
+        second.substitute( Operand::direct );
+    } else if ( first.state != Argument::empty && !first.is_final() ) {
+        first.substitute( Operand::direct );
+    }
+}
+
+/// Splits the first token off a normalized line.
+std::string_view next_token( std::string_view &text ) {
+    size_t end = std::min( text.find( ' ' ), text.size() );
+    auto token = text.substr( 0, end );
+    text.remove_prefix( std::min( end + 1, text.size() ) );
+    return token;
+}
+
+bool Assembler::assemble( std::string_view new_source ) {
+    std::vector<std::string_view> new_lines;
+    new_lines.reserve( std::count( new_source.begin(), new_source.end(), '\n' ) + 1 );
+    for ( size_t index = 0; index < new_source.size(); ) {
+        size_t end = std::min( new_source.find( '\n', index ), new_source.size() );
+        new_lines.push_back( new_source.substr( index, end - index ) );
+        index = end + 1;
+    }
+
+    // Unchanged lines at the beginning and the end are kept, unless they had messages (which are repeated).
+    auto unchanged = [&]( size_t old_index, size_t new_index ) {
+        auto &old_line = lines[old_index];
+        return old_line.clean &&
+               std::string_view( source ).substr( old_line.source_pos, old_line.source_size ) == new_lines[new_index];
+    };
+    size_t first = 0;
+    while ( first < lines.size() && first < new_lines.size() && unchanged( first, first ) )
+        first++;
+    size_t kept = 0; // Lines at the end.
+    while ( first + kept < lines.size() && first + kept < new_lines.size() &&
+            unchanged( lines.size() - 1 - kept, new_lines.size() - 1 - kept ) )
+        kept++;
+    size_t old_end = lines.size() - kept;
+    size_t new_end = new_lines.size() - kept;
+
+    // Remove the changed lines, the kept lines behind them are appended again after the new ones were assembled.
+    size_t begin_addr = first < lines.size() ? lines[first].addr : code.size();
+    size_t end_addr = old_end < lines.size() ? lines[old_end].addr : code.size();
+    size_t fixup_begin = first > 0 ? lines[first - 1].fixup_end : 0;
+    size_t fixup_end = old_end > 0 ? lines[old_end - 1].fixup_end : 0;
+    std::vector<bool> moved( label_targets.size() ); // Labels whose address changed.
+    for ( size_t i = first; i < old_end; i++ ) {
+        if ( lines[i].label >= 0 ) {
+            label_targets[lines[i].label] = -1;
+            moved[lines[i].label] = true;
+        }
+    }
+    size_t old_size = code.size();
+    std::vector<u8> old_code( code.begin() + begin_addr, code.end() );
+    std::vector<Fixup> tail_fixups( fixups.begin() + fixup_end, fixups.end() );
+    std::vector<Line> tail_lines( lines.begin() + old_end, lines.end() );
+    code.resize( begin_addr );
+    fixups.resize( fixup_begin );
+    lines.resize( first );
+    lines.reserve( new_lines.size() );
+
+    successful = true;
+    for ( size_t i = first; i < new_end; i++ ) {
+        line_no = i + 1;
+        line_label = -1;
+        line_clean = true;
+        size_t addr = code.size();
+        assemble_line( new_lines[i] );
+        lines.push_back( { static_cast<size_t>( new_lines[i].data() - new_source.data() ), new_lines[i].size(), addr,
+                           fixups.size(), line_label, line_clean } );
+    }
+    moved.resize( label_targets.size(), true );
+    for ( size_t i = first; i < new_end; i++ ) {
+        if ( lines[i].label >= 0 )
+            moved[lines[i].label] = true;
+    }
+
+    size_t middle_end = code.size();
+    size_t fixup_middle_end = fixups.size();
+    auto shift = static_cast<i64>( middle_end ) - static_cast<i64>( end_addr );
+    code.insert( code.end(), old_code.begin() + ( end_addr - begin_addr ), old_code.end() );
+    for ( auto &fixup : tail_fixups ) {
+        fixup.pos += shift;
+        fixups.push_back( fixup );
+    }
+    for ( size_t i = 0; i < tail_lines.size(); i++ ) {
+        auto &tail_line = tail_lines[i];
+        tail_line.source_pos = new_lines[new_end + i].data() - new_source.data();
+        tail_line.addr += shift;
+        tail_line.fixup_end = tail_line.fixup_end - fixup_end + fixup_middle_end;
+        if ( tail_line.label >= 0 && shift != 0 ) {
+            label_targets[tail_line.label] = static_cast<u16>( tail_line.addr );
+            moved[tail_line.label] = true;
+        }
+        lines.push_back( tail_line );
+    }
+    source.assign( new_source );
+
+    // Fill in the references of the new lines and the references whose label or position (relative jumps and the
+    // 2Ki-block of AJMP/ACALL) moved. References outside of the new lines extend the changed range if they changed.
+    std::pair<size_t, size_t> relinked = { code.size(), 0 };
+    for ( size_t i = 0; i < fixups.size(); i++ ) {
+        auto &fixup = fixups[i];
+        bool is_new = i >= fixup_begin && i < fixup_middle_end;
+        bool position_moved = i >= fixup_middle_end && shift != 0 && fixup.kind != Fixup::absolute16;
+        if ( !is_new && !position_moved && !moved[fixup.label] )
+            continue;
+        size_t pos = fixup.pos;
+        size_t last = fixup.kind == Fixup::relative8 ? pos : pos + 1;
+        std::array<u8, 2> before = { code[pos], code[last] };
+        link( i );
+        if ( !is_new && ( code[pos] != before[0] || code[last] != before[1] ) ) {
+            relinked.first = std::min( relinked.first, pos );
+            relinked.second = std::max( relinked.second, last + 1 );
+        }
+    }
+
+    // The new lines changed from their first different byte to their last one (or to the end if the code behind them
+    // moved).
+    auto new_begin = code.begin() + begin_addr;
+    auto old_begin = old_code.begin();
+    if ( shift == 0 ) {
+        auto new_middle_end = code.begin() + middle_end;
+        size_t first_changed = std::mismatch( new_begin, new_middle_end, old_begin ).first - code.begin();
+        size_t last_changed = first_changed;
+        for ( size_t addr = middle_end; addr > first_changed; addr-- ) {
+            if ( code[addr - 1] != old_code[addr - 1 - begin_addr] ) {
+                last_changed = addr;
+                break;
+            }
+        }
+        changed = { first_changed, last_changed };
+    } else {
+        changed = { std::mismatch( new_begin, code.end(), old_begin, old_code.end() ).first - code.begin(),
+                    std::max( old_size, code.size() ) };
+    }
+    if ( changed.first == changed.second )
+        changed = relinked;
+    else if ( relinked.first < relinked.second )
+        changed = { std::min( changed.first, relinked.first ), std::max( changed.second, relinked.second ) };
+    if ( changed.first >= changed.second )
+        changed = { 0, 0 };
+    return successful;
+}
+
+std::map<u16, String> Assembler::symbols() const {
+    std::vector<const String *> names( label_targets.size() );
+    for ( auto &[label, id] : label_ids )
+        names[id] = &label;
+    std::map<u16, String> result;
+    for ( auto &source_line : lines ) {
+        if ( source_line.label >= 0 )
+            result.try_emplace( label_targets[source_line.label], *names[source_line.label] );
+    }
+    return result;
+}
+
+void Assembler::assemble_line( std::string_view source_line ) {
+    if ( !source_line.empty() && source_line.back() == '\r' )
+        source_line.remove_suffix( 1 );
+    source_line.remove_prefix( std::min( source_line.find_first_not_of( ' ' ), source_line.size() ) );
+
+    // Strings are taken as they are. Everything else is normalized in one pass: the comment is removed, commas and
+    // tabs separate tokens like spaces and the tokens are joined by single spaces in lower case.
+    std::string_view text = source_line;
+    if ( text.substr( 0, 5 ) != ".str " ) {
+        line.clear();
+        bool separated = false;
+        for ( char c : source_line ) {
+            if ( c == ';' )
+                break;
+            if ( c == ' ' || c == ',' || c == '\t' || c == '\r' ) {
+                separated = true;
+                continue;
+            }
+            if ( separated && !line.empty() )
+                line.push_back( ' ' );
+            separated = false;
+            line.push_back( c >= 'A' && c <= 'Z' ? c - 'A' + 'a' : c );
+        }
+        text = line;
+    }
+
+    if ( text.empty() )
+        return;
+
+    if ( text.find( ':' ) != text.npos ) {
+        // Label
+        if ( text.find( ':' ) != text.size() - 1 ) {
+            report( "Invalid label syntax.", true );
+        }
+        auto label = text.substr( 0, text.size() - 1 );
+        u32 id = label_id( label );
+        if ( label_targets[id] >= 0 ) {
+            report( "Found label '" + String( label ) + "' multiple times (line " + to_string( line_no ) + ")", true );
+        } else {
+            label_targets[id] = static_cast<u16>( code.size() );
+            line_label = id;
+        }
+    } else if ( text.substr( 0, 6 ) == ".data " ) {
+        // Inline byte data
+        for ( size_t i = 6; i < text.size(); i += 2 ) {
+            auto digits = text.substr( i, 2 );
+            i32 number;
+            bool valid = parse_number( digits, number );
+            auto value = static_cast<u8>( number );
+            if ( valid && digits != to_hex_str( value, digits.size() * 4 ) )
+                report( "Warning: possible misinterpretation at line " + to_string( line_no ), false );
+            code.push_back( value );
+        }
+    } else if ( text.substr( 0, 5 ) == ".str " ) {
+        // Inline string data
+        code.insert( code.end(), text.begin() + 5, text.end() );
+    } else {
+        assemble_instruction( text );
+    }
+}
+
+void Assembler::assemble_instruction( std::string_view text ) {
+    // The register of CJNE is part of the signature (like the mnemonic), the arguments are substituted. The second
+    // argument is the rest of the line, so surplus tokens don't match.
+    auto mnemonic_word = find_word( next_token( text ) );
+    u8 mnemonic = mnemonic_word ? mnemonic_word->mnemonic : no_mnemonic;
+    bool cjne = mnemonic == static_cast<u8>( Mnemonic::cjne );
+    bool mov = mnemonic == static_cast<u8>( Mnemonic::mov );
+    u8 cjne_register = cjne ? Argument( next_token( text ) ).signature_class() : 0;
+    Argument first( next_token( text ) );
+    Argument second( text );
+    if ( cjne && second.state == Argument::empty )
+        mnemonic = no_mnemonic; // CJNE needs all three operands.
+
+    auto key = [&]() {
+        return cjne ? signature( mnemonic, cjne_register, first.signature_class(), second.signature_class() )
+                    : signature( mnemonic, first.signature_class(), second.signature_class(), 0 );
+    };
+    i32 found = mnemonic != no_mnemonic ? find_opcode( key() ) : -1;
+    for ( int step = 0; step < 3 && found < 0 && mnemonic != no_mnemonic; step++ ) {
+        substitute_arguments( first, second, cjne, mov );
+        found = find_opcode( key() );
+    }
+    if ( found < 0 ) {
+        report( "Unknown command/syntax at line " + to_string( line_no ) + ".", true );
+        return;
+    }
+
+    // Translate into machine code.
+    auto opcode = static_cast<u8>( found );
+    auto &info = instruction_set[opcode];
+    code.push_back( opcode );
+    if ( info.operand_count() == 0 )
+        return;
+    if ( info.operands[0] == Operand::addr16 ) {
+        if ( is_hex_number( first.text ) ) {
+            i32 addr;
+            parse_number( first.text, addr );
+            code.push_back( ( addr >> 8 ) & 0xFF );
+            code.push_back( addr & 0xFF );
+        } else {
+            add_fixup( Fixup::absolute16, first.text, code.size() );
+            code.insert( code.end(), 2, 0 );
+        }
+        return;
+    }
+    if ( info.operands[0] == Operand::addr11 ) {
+        if ( is_hex_number( first.text ) ) {
+            i32 addr;
+            parse_number( first.text, addr );
+            code.back() = ( code.back() & 0x1F ) | ( ( ( addr >> 8 ) & 0x07 ) << 5 );
+            code.push_back( addr & 0xFF );
+        } else {
+            add_fixup( Fixup::absolute11, first.text, code.size() - 1 );
+            code.push_back( 0 );
+        }
+        return;
+    }
+
+    std::array<std::string_view, 2> arguments = { first.text, second.text };
+    size_t argument_count = second.text.empty() ? 1 : 2;
+    if ( opcode == 0x85 ) {
+        // MOV direct, direct has the source first.
+        std::swap( arguments[0], arguments[1] );
+        argument_count = 2;
+    }
+    size_t i = cjne ? 1 : 0; // The register of CJNE has no argument.
+    for ( size_t a = 0; a < argument_count; a++, i++ ) {
+        auto arg = arguments[a];
+        Operand operand = info.operands[i];
+        if ( operand == Operand::direct || operand == Operand::bit || operand == Operand::not_bit ||
+             operand == Operand::immediate || operand == Operand::immediate16 ) {
+            if ( !arg.empty() && arg[0] == '/' )
+                arg.remove_prefix( 1 );
+            auto word = find_word( arg );
+            u8 value = 0;
+            if ( word && word->is_sfr ) {
+                // Translate SFR
+                value = word->sfr;
+            } else {
+                if ( !arg.empty() && arg[0] == '(' )
+                    arg = arg.substr( 1, arg.size() - 2 );
+                if ( opcode == 0x90 ) {
+                    // "mov dptr" with two bytes
+                    if ( is_hex_number( arg ) ) {
+                        i32 data;
+                        parse_number( arg, data );
+                        code.push_back( ( data >> 8 ) & 0xFF );
+                        code.push_back( data & 0xFF );
+                    } else {
+                        add_fixup( Fixup::absolute16, arg, code.size() );
+                        code.insert( code.end(), 2, 0 );
+                    }
+                } else {
+                    i32 number;
+                    if ( parse_number( arg, number ) && is_misinterpreted( arg, number ) )
+                        report( "Warning: possible misinterpretation at line " + to_string( line_no ), false );
+                    value = static_cast<u8>( number );
+                }
+            }
+            if ( opcode != 0x90 ) // Already inserted (see above).
+                code.push_back( value );
+        } else if ( operand == Operand::offset ) {
+            if ( is_hex_number( arg ) ) {
+                i32 offset;
+                if ( parse_number( arg, offset ) && is_misinterpreted( arg, offset ) )
+                    report( "Warning: possible misinterpretation at line " + to_string( line_no ), false );
+                code.push_back( static_cast<u8>( offset ) );
+            } else {
+                add_fixup( Fixup::relative8, arg, code.size() );
+                code.push_back( 0 );
+            }
+        }
+    }
+}
+
+void Assembler::add_fixup( Fixup::Kind kind, std::string_view label, size_t pos ) {
+    fixups.push_back( { kind, label_id( label ), pos } );
+}
+
+u32 Assembler::label_id( std::string_view label ) {
+    auto [itr, inserted] = label_ids.try_emplace( String( label ), static_cast<u32>( label_targets.size() ) );
+    if ( inserted )
+        label_targets.push_back( -1 );
+    return itr->second;
+}
+
+bool Assembler::parse_number( std::string_view text, i32 &value ) {
+    size_t i = 0;
+    while ( i < text.size() && text[i] == ' ' )
+        i++;
+    bool negative = i < text.size() && text[i] == '-';
+    if ( i < text.size() && ( text[i] == '-' || text[i] == '+' ) )
+        i++;
+    if ( text.substr( i, 2 ) == "0x" && i + 2 < text.size() && hex_digit( text[i + 2] ) >= 0 )
+        i += 2;
+
+    i64 magnitude = 0;
+    size_t digits = 0;
+    for ( ; i < text.size() && hex_digit( text[i] ) >= 0; i++, digits++ )
+        magnitude = std::min<i64>( magnitude * 16 + hex_digit( text[i] ), i64( 1 ) << 32 );
+    if ( digits == 0 || magnitude > ( negative ? i64( 1 ) << 31 : ( i64( 1 ) << 31 ) - 1 ) ) {
+        report( "Invalid number '" + String( text ) + "' at line " + to_string( line_no ) + ".", true );
+        value = 0;
+        return false;
+    }
+    value = static_cast<i32>( negative ? -magnitude : magnitude );
+    return true;
+}
+
+void Assembler::report( const String &message, bool error ) {
+    log( message );
+    line_clean = false;
+    if ( error )
+        successful = false;
+}
+
+void Assembler::link( size_t index ) {
+    auto &fixup = fixups[index];
+    u16 target = std::max( label_targets[fixup.label], 0 ); // Undefined labels are 0.
+    auto pos = fixup.pos;
+    bool in_range = true;
+    switch ( fixup.kind ) {
+    case Fixup::relative8: {
+        auto offset = static_cast<i16>( target - pos - 1 );
+        if ( offset > 127 || offset < -128 ) {
+            log( LogLevel::error, "Relative jump offset is too far." );
+            in_range = false;
+        }
+        code[pos] = static_cast<u8>( offset );
+        break;
+    }
+    case Fixup::absolute11:
+        if ( ( target & 0xF800 ) != ( ( pos + 2 ) & 0xF800 ) ) {
+            log( LogLevel::error, "Relative jump is too far (not the same 2Ki-block)." );
+            in_range = false;
+        }
+        code[pos] = ( code[pos] & 0x1F ) | ( ( ( target >> 8 ) & 0x07 ) << 5 );
+        code[pos + 1] = target & 0xFF;
+        break;
+    case Fixup::absolute16:
+        code[pos] = ( target >> 8 ) & 0xFF;
+        code[pos + 1] = target & 0xFF;
+        break;
+    }
+    if ( !in_range ) {
+        // The line is assembled again next time, so the error is repeated.
+        successful = false;
+        auto owner = std::upper_bound( lines.begin(), lines.end(), index,
+                                       []( size_t i, const Line &line ) { return i < line.fixup_end; } );
+        owner->clean = false;
+    }
+}
+
+void encode_hex_file( const std::vector<u8> &code, std::ostream &output ) {
+    constexpr size_t record_size = 16;
+    char record[12 + 2 * record_size]; // ":", size, address, type, data, checksum and line break.
+    for ( size_t addr = 0; addr < code.size(); addr += record_size ) {
+        size_t size = std::min( record_size, code.size() - addr );
+        u8 checksum = size + ( addr & 0xff ) + ( addr >> 8 );
+        record[0] = ':';
+        write_hex( record + 1, size, 2 );
+        write_hex( record + 3, addr, 4 );
+        write_hex( record + 7, 0, 2 ); // Data record
+        for ( size_t i = 0; i < size; i++ ) {
+            write_hex( record + 9 + 2 * i, code[addr + i], 2 );
+            checksum += code[addr + i];
+        }
+        write_hex( record + 9 + 2 * size, static_cast<u8>( ~checksum + 1 ), 2 );
+        record[11 + 2 * size] = '\n';
+        output.write( record, 12 + 2 * size );
+    }
+    output << ":00000001ff\n";
+}
+
+void compile_assembly( const String &code, std::ostream &output ) {
+    Assembler assembler;
+    if ( assembler.assemble( code ) ) {
+        encode_hex_file( assembler.code, output );
+        log( "Compilation successful." );
+    }
+}
+
+bool compile_assembly( const String &code, Processor &processor, std::ostream *hex_output ) {
+    Assembler assembler;
+    if ( !assembler.assemble( code ) || !processor.load_code( assembler.code ) )
+        return false;
+    processor.symbols = assembler.symbols();
+    if ( hex_output )
+        encode_hex_file( assembler.code, *hex_output );
+    log( "Compilation successful." );
+    return true;
+}
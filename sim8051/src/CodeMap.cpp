@@ -0,0 +1,205 @@
+#include "sim8051/stdafx.hpp"
+#include "sim8051/CodeMap.hpp"
+#include "sim8051/Encoding.hpp"
+
+constexpr u16 vectors[] = { 0x00, 0x03, 0x0B, 0x13, 0x1B, 0x23 }; // Reset and interrupts.
+
+void CodeMap::build( const Processor &processor ) {
+    auto &text = std::as_const( processor.text );
+    std::copy( text.begin(), text.end(), bytes.begin() );
+    entry_points.clear();
+    decode();
+}
+
+std::pair<size_t, size_t> CodeMap::update( const Processor &processor ) {
+    constexpr size_t block_size = 256; // Equal blocks are skipped with a single comparison.
+    auto &text = std::as_const( processor.text );
+
+    size_t first = size;
+    size_t last = 0;
+    for ( size_t block = 0; block < size; block += block_size ) {
+        if ( std::equal( bytes.begin() + block, bytes.begin() + block + block_size, text.begin() + block ) )
+            continue;
+        for ( size_t addr = block; addr < block + block_size; addr++ ) {
+            if ( bytes[addr] != text[addr] ) {
+                first = std::min( first, addr );
+                last = addr + 1;
+            }
+        }
+    }
+    if ( first == size )
+        return { 0, 0 };
+    std::copy( text.begin() + first, text.begin() + last, bytes.begin() + first );
+
+    // Bytes which aren't reachable can't change the control flow, unless they are a vector.
+    bool affects_code = std::any_of( std::begin( vectors ), std::end( vectors ),
+                                     [&]( u16 vector ) { return vector >= first && vector < last; } );
+    for ( size_t addr = first; addr < last && !affects_code; addr++ )
+        affects_code = code.test( addr );
+    if ( !affects_code )
+        return { first, last };
+
+    auto old_instructions = instructions;
+    decode();
+    for ( size_t word = 0; word < instructions.word_count; word++ ) {
+        if ( instructions.words[word] != old_instructions.words[word] ) {
+            first = std::min( first, word * 64 );
+            last = std::max( last, word * 64 + 64 );
+        }
+    }
+    return { first, last };
+}
+
+bool CodeMap::add_entry_point( u16 addr ) {
+    if ( instructions.test( addr ) )
+        return true;
+    if ( code.test( addr ) )
+        return false;
+    entry_points.push_back( addr );
+    bool had_interrupts = interrupts_enabled;
+    trace( addr );
+    if ( !had_interrupts && interrupts_enabled )
+        trace_vectors(); // The new code enables interrupts.
+    return true;
+}
+
+std::vector<u16> CodeMap::list() const {
+    std::vector<u16> rows;
+    for ( size_t addr = 0; addr < size; addr += row_size( addr ) )
+        rows.push_back( addr );
+    return rows;
+}
+
+u8 CodeMap::row_size( u16 addr ) const {
+    if ( instructions.test( addr ) )
+        return get_instruction_size( bytes[addr] );
+    size_t end = addr + 1;
+    while ( end < size && end % data_row_size != 0 && !code.test( end ) )
+        end++;
+    return end - addr;
+}
+
+void CodeMap::decode() {
+    // The first pass finds the tables, the second one ends the paths which run into them.
+    tables.reset();
+    for ( int pass = 0; pass < 2; pass++ ) {
+        if ( pass == 1 && !tables.any() )
+            break;
+        instructions.reset();
+        code.reset();
+        interrupts_enabled = false;
+        // The vectors come last, as IE may also be written by the code of an additional entry point.
+        trace( vectors[0] );
+        for ( auto addr : entry_points )
+            trace( addr );
+        if ( interrupts_enabled )
+            trace_vectors();
+    }
+}
+
+void CodeMap::trace_vectors() {
+    for ( size_t i = 1; i < std::size( vectors ); i++ ) {
+        if ( bytes[vectors[i]] != 0 ) // Unused vectors are usually zero padding.
+            trace( vectors[i] );
+    }
+}
+
+bool CodeMap::writes_direct( size_t addr, u8 direct ) const {
+    u8 opcode = bytes[addr];
+    switch ( opcode ) {
+    case 0x92: // MOV bit, C
+    case 0xB2: // CPL bit
+    case 0xD2: // SETB bit
+        return ( bytes[addr + 1] & 0xf8 ) == direct;
+    case 0x85: // MOV direct, direct (destination last)
+        return bytes[addr + 2] == direct;
+    case 0x05: // INC direct
+    case 0x15: // DEC direct
+    case 0x42: // ORL direct, A
+    case 0x43: // ORL direct, #data
+    case 0x75: // MOV direct, #data
+    case 0x86: // MOV direct, @R0
+    case 0x87: // MOV direct, @R1
+    case 0xC5: // XCH A, direct
+    case 0xD0: // POP direct
+    case 0xF5: // MOV direct, A
+        return bytes[addr + 1] == direct;
+    default:
+        return opcode >= 0x88 && opcode <= 0x8F && bytes[addr + 1] == direct; // MOV direct, Rn
+    }
+}
+
+void CodeMap::trace( u16 entry ) {
+    constexpr i32 unknown = -1; // Value of DPTR which isn't known on a path.
+    constexpr u8 ie = 0xA8;
+    constexpr u8 dpl = 0x82;
+    constexpr u8 dph = 0x83;
+
+    // Paths to decode, with the value of DPTR at their start.
+    std::vector<std::pair<u16, i32>> pending{ { entry, unknown } };
+    while ( !pending.empty() ) {
+        size_t addr = pending.back().first;
+        i32 dptr = pending.back().second;
+        pending.pop_back();
+        bool jump_target = true;
+        while ( addr < size && !instructions.test( addr ) ) {
+            if ( !jump_target && tables.test( addr ) )
+                break;
+            u8 opcode = bytes[addr];
+            size_t next = addr + get_instruction_size( opcode );
+            if ( next > size )
+                break;
+            bool overlaps = false;
+            for ( size_t i = addr; i < next; i++ )
+                overlaps |= code.test( i );
+            if ( overlaps )
+                break; // Inside another instruction (or overlapping it).
+            instructions.set( addr );
+            for ( size_t i = addr; i < next; i++ )
+                code.set( i );
+
+            // The relative offset is always the last byte.
+            auto relative_target = static_cast<u16>( next + static_cast<i8>( bytes[next - 1] ) );
+            bool falls_through = true;
+            if ( ( opcode & 0x0f ) == 0x01 ) {
+                // AJMP or ACALL, the page is taken from the address of the next instruction.
+                u16 page = next & 0xf800;
+                pending.push_back( { static_cast<u16>( page | ( ( opcode & 0xe0 ) << 3 ) | bytes[addr + 1] ), dptr } );
+                falls_through = opcode & 0x10;
+                if ( falls_through )
+                    dptr = unknown; // The subroutine may change it.
+            } else if ( opcode == 0x02 || opcode == 0x12 ) {
+                // LJMP or LCALL
+                pending.push_back( { static_cast<u16>( ( bytes[addr + 1] << 8 ) | bytes[addr + 2] ), dptr } );
+                falls_through = opcode == 0x12;
+                if ( falls_through )
+                    dptr = unknown;
+            } else if ( opcode == 0x80 ) {
+                // SJMP
+                pending.push_back( { relative_target, dptr } );
+                falls_through = false;
+            } else if ( is_conditional_branch( opcode ) ) {
+                pending.push_back( { relative_target, dptr } );
+            } else if ( opcode == 0x22 || opcode == 0x32 || opcode == 0x73 || opcode == 0xA5 ) {
+                // RET, RETI, JMP @A+DPTR (target unknown) and the reserved op code
+                falls_through = false;
+            } else if ( opcode == 0x90 ) {
+                // MOV DPTR, #data16
+                dptr = ( bytes[addr + 1] << 8 ) | bytes[addr + 2];
+            } else if ( opcode == 0x93 ) {
+                // MOVC A, @A+DPTR
+                if ( dptr != unknown )
+                    tables.set( dptr );
+            } else if ( opcode == 0xA3 || writes_direct( addr, dpl ) || writes_direct( addr, dph ) ) {
+                // INC DPTR or a write to DPL or DPH
+                dptr = unknown;
+            } else if ( writes_direct( addr, ie ) ) {
+                interrupts_enabled = true;
+            }
+            if ( !falls_through )
+                break;
+            addr = next;
+            jump_target = false;
+        }
+    }
+}
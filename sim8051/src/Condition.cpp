@@ -0,0 +1,204 @@
+#include "sim8051/stdafx.hpp"
+#include "sim8051/Condition.hpp"
+#include "sim8051/Encoding.hpp"
+
+/// Recursive descent parser which emits the bytecode while parsing.
+class ConditionParser {
+    const String &str;
+    size_t pos = 0;
+    int depth = 0; // Current stack depth of the emitted code.
+    Condition &condition;
+
+    void emit( Condition::Op op, u32 arg = 0 ) { condition.code.push_back( { op, arg } ); }
+
+    /// Emits an instruction and updates the stack depth.
+    bool emit_stack( Condition::Op op, int stack_change, u32 arg = 0 ) {
+        emit( op, arg );
+        depth += stack_change;
+        if ( depth > static_cast<int>( Condition::max_stack_size ) ) {
+            error = "Expression is too complex";
+            return false;
+        }
+        return true;
+    }
+
+    void skip_space() {
+        while ( pos < str.size() && isspace( static_cast<unsigned char>( str[pos] ) ) )
+            pos++;
+    }
+
+    /// Consumes a symbol if it's next in the input.
+    bool accept( const String &symbol ) {
+        skip_space();
+        size_t end = pos + symbol.size();
+        if ( str.compare( pos, symbol.size(), symbol ) != 0 )
+            return false;
+        if ( isalpha( static_cast<unsigned char>( symbol[0] ) ) && end < str.size() &&
+             isalnum( static_cast<unsigned char>( str[end] ) ) )
+            return false; // Only a prefix of a longer word.
+        if ( ( symbol == "&" || symbol == "|" ) && end < str.size() && str[end] == symbol[0] )
+            return false; // Logical operator.
+        pos = end;
+        return true;
+    }
+
+    /// Parses a binary operator level. "ops" maps symbols to op codes.
+    bool binary( bool ( ConditionParser::*operand )(),
+                 std::initializer_list<std::pair<const char *, Condition::Op>> ops ) {
+        if ( !( this->*operand )() )
+            return false;
+        while ( true ) {
+            bool found = false;
+            for ( auto &op : ops ) {
+                if ( accept( op.first ) ) {
+                    if ( !( this->*operand )() || !emit_stack( op.second, -1 ) )
+                        return false;
+                    found = true;
+                    break;
+                }
+            }
+            if ( !found )
+                return true;
+        }
+    }
+
+    bool logical_or() {
+        return binary( &ConditionParser::logical_and,
+                       { { "||", Condition::logical_or }, { "or", Condition::logical_or } } );
+    }
+    bool logical_and() {
+        return binary( &ConditionParser::comparison,
+                       { { "&&", Condition::logical_and }, { "and", Condition::logical_and } } );
+    }
+    bool comparison() {
+        // Longer symbols first, so "<=" isn't read as "<".
+        return binary( &ConditionParser::bitwise_or, { { "==", Condition::eq },
+                                                       { "!=", Condition::ne },
+                                                       { "<=", Condition::le },
+                                                       { ">=", Condition::ge },
+                                                       { "<", Condition::lt },
+                                                       { ">", Condition::gt } } );
+    }
+    bool bitwise_or() { return binary( &ConditionParser::bitwise_xor, { { "|", Condition::bitwise_or } } ); }
+    bool bitwise_xor() { return binary( &ConditionParser::bitwise_and, { { "^", Condition::bitwise_xor } } ); }
+    bool bitwise_and() { return binary( &ConditionParser::additive, { { "&", Condition::bitwise_and } } ); }
+    bool additive() {
+        return binary( &ConditionParser::multiplicative, { { "+", Condition::add }, { "-", Condition::sub } } );
+    }
+    bool multiplicative() { return binary( &ConditionParser::unary, { { "*", Condition::mul } } ); }
+
+    bool unary() {
+        if ( accept( "-" ) )
+            return unary() && emit_stack( Condition::negate, 0 );
+        if ( accept( "~" ) )
+            return unary() && emit_stack( Condition::bitwise_not, 0 );
+        if ( accept( "!" ) || accept( "not" ) )
+            return unary() && emit_stack( Condition::logical_not, 0 );
+        return primary();
+    }
+
+    bool primary() {
+        skip_space();
+        if ( accept( "(" ) ) {
+            if ( !logical_or() )
+                return false;
+            if ( !accept( ")" ) ) {
+                error = "Missing ')'";
+                return false;
+            }
+            return true;
+        }
+
+        size_t begin = pos;
+        while ( pos < str.size() && ( isalnum( static_cast<unsigned char>( str[pos] ) ) || str[pos] == '_' ) )
+            pos++;
+        String word = to_lower( str.substr( begin, pos - begin ) );
+        if ( word.empty() ) {
+            error = "Expected a value";
+            return false;
+        }
+
+        // Memory access
+        Condition::Op memory_op = Condition::push;
+        if ( word == "iram" )
+            memory_op = Condition::load_iram;
+        else if ( word == "xram" )
+            memory_op = Condition::load_xram;
+        else if ( word == "code" )
+            memory_op = Condition::load_code;
+        if ( memory_op != Condition::push ) {
+            if ( !accept( "[" ) ) {
+                error = "Expected '[' after '" + word + "'";
+                return false;
+            }
+            if ( !logical_or() )
+                return false;
+            if ( !accept( "]" ) ) {
+                error = "Missing ']'";
+                return false;
+            }
+            return emit_stack( memory_op, 0 );
+        }
+
+        // Named values
+        u8 addr;
+        bool is_bit;
+        if ( word.size() == 2 && word[0] == 'r' && word[1] >= '0' && word[1] <= '7' )
+            return emit_stack( Condition::load_reg, 1, word[1] - '0' );
+        if ( word == "pc" )
+            return emit_stack( Condition::load_pc, 1 );
+        if ( word == "dptr" )
+            return emit_stack( Condition::load_dptr, 1 );
+        if ( word == "cycles" )
+            return emit_stack( Condition::load_cycles, 1 );
+        if ( lookup_sfr_name( word, addr, is_bit ) )
+            return emit_stack( is_bit ? Condition::load_bit : Condition::load_direct, 1, addr );
+
+        // Number
+        String digits = word.size() > 2 && word[0] == '0' && word[1] == 'x' ? word.substr( 2 ) : word;
+        if ( digits.find_first_not_of( "0123456789abcdef" ) != digits.npos ) {
+            error = "Unknown name '" + word + "'";
+            return false;
+        }
+        if ( digits.find_first_not_of( '0' ) != digits.npos && digits.size() - digits.find_first_not_of( '0' ) > 8 ) {
+            error = "Number '" + word + "' is too large";
+            return false;
+        }
+        return emit_stack( Condition::push, 1, static_cast<u32>( std::stoul( digits, 0, 16 ) ) );
+    }
+
+public:
+    String error;
+
+    ConditionParser( const String &str, Condition &condition ) : str( str ), condition( condition ) {}
+
+    bool parse() {
+        if ( !logical_or() )
+            return false;
+        skip_space();
+        if ( pos != str.size() ) {
+            error = "Unexpected '" + str.substr( pos, 1 ) + "'";
+            return false;
+        }
+        return true;
+    }
+
+    size_t position() const { return pos; }
+};
+
+bool compile_condition( const String &expression, Condition &condition ) {
+    Condition tmp;
+    if ( expression.find_first_not_of( " \t" ) == expression.npos ) {
+        condition = tmp; // Always true.
+        return true;
+    }
+
+    ConditionParser parser( expression, tmp );
+    if ( !parser.parse() ) {
+        log( LogLevel::error,
+             "Invalid condition: " + parser.error + " (at character " + to_string( parser.position() + 1 ) + ")" );
+        return false;
+    }
+    condition = std::move( tmp );
+    return true;
+}
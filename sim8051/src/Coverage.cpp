@@ -0,0 +1,118 @@
+#include "sim8051/stdafx.hpp"
+#include "sim8051/Coverage.hpp"
+#include "sim8051/Processor.hpp"
+#include "sim8051/Encoding.hpp"
+#include "sim8051/CodeMap.hpp"
+
+constexpr char coverage_file_magic[8] = { 'S', '8', '0', '5', '1', 'C', 'O', 'V' };
+
+void Coverage::clear() {
+    executed.reset();
+    branch_taken.reset();
+    branch_not_taken.reset();
+}
+
+void Coverage::merge( const Coverage &other ) {
+    executed |= other.executed;
+    branch_taken |= other.branch_taken;
+    branch_not_taken |= other.branch_not_taken;
+}
+
+bool Coverage::save( const String &file ) const {
+    std::ofstream stream( file, std::ios::binary );
+    if ( !stream.good() ) {
+        log( LogLevel::error, "Failed to write coverage file '" + file + "'" );
+        return false;
+    }
+
+    stream.write( coverage_file_magic, sizeof( coverage_file_magic ) );
+    for ( auto *bitmap : { &executed, &branch_taken, &branch_not_taken } ) {
+        for ( auto word : bitmap->words ) {
+            // Always little endian, so files can be merged on any host.
+            char bytes[8];
+            for ( size_t i = 0; i < 8; i++ )
+                bytes[i] = static_cast<char>( ( word >> ( i * 8 ) ) & 0xff );
+            stream.write( bytes, 8 );
+        }
+    }
+    return stream.good();
+}
+
+bool Coverage::load( const String &file ) {
+    std::ifstream stream( file, std::ios::binary );
+    char magic[sizeof( coverage_file_magic )];
+    if ( !stream.read( magic, sizeof( magic ) ) ||
+         !std::equal( magic, magic + sizeof( magic ), coverage_file_magic ) ) {
+        log( LogLevel::error, "Invalid coverage file '" + file + "'" );
+        return false;
+    }
+
+    for ( auto *bitmap : { &executed, &branch_taken, &branch_not_taken } ) {
+        for ( auto &word : bitmap->words ) {
+            unsigned char bytes[8];
+            if ( !stream.read( reinterpret_cast<char *>( bytes ), 8 ) ) {
+                log( LogLevel::error, "Truncated coverage file '" + file + "'" );
+                return false;
+            }
+            word = 0;
+            for ( size_t i = 0; i < 8; i++ )
+                word |= static_cast<u64>( bytes[i] ) << ( i * 8 );
+        }
+    }
+    return true;
+}
+
+/// Collects the instruction addresses which are part of the report: the decoded program, extended by all addresses
+/// which were actually executed (e. g. targets of JMP @A+DPTR or code which was decoded differently).
+std::vector<u16> listed_instructions( const Processor &processor, const Coverage &coverage ) {
+    CodeMap code_map;
+    code_map.build( processor );
+    std::vector<u16> conflicts;
+    for ( size_t i = 0; i < processor.text.size(); i++ ) {
+        if ( coverage.executed.test( i ) && !code_map.add_entry_point( i ) )
+            conflicts.push_back( i );
+    }
+
+    std::vector<u16> ret = conflicts;
+    for ( size_t i = 0; i < processor.text.size(); i++ ) {
+        if ( code_map.instructions.test( i ) )
+            ret.push_back( i );
+    }
+    std::sort( ret.begin(), ret.end() );
+    return ret;
+}
+
+void Coverage::write_listing( std::ostream &output, const Processor &processor ) const {
+    for ( auto addr : listed_instructions( processor, *this ) ) {
+        output << get_instruction_listing_string( processor, addr ) << '\n';
+    }
+}
+
+void Coverage::write_lcov( std::ostream &output, const Processor &processor, const String &source_name ) const {
+    size_t lines_found = 0;
+    size_t lines_hit = 0;
+    size_t branches_found = 0;
+    size_t branches_hit = 0;
+
+    output << "TN:\nSF:" << source_name << '\n';
+    auto instructions = listed_instructions( processor, *this );
+    for ( size_t i = 0; i < instructions.size(); i++ ) {
+        u16 addr = instructions[i];
+        size_t line = i + 1;
+        bool hit = executed.test( addr );
+        if ( is_conditional_branch( processor.text[addr] ) ) {
+            // Branch 0 is the jump, branch 1 the fall through.
+            output << "BRDA:" << line << ",0,0," << ( hit ? ( branch_taken.test( addr ) ? "1" : "0" ) : "-" ) << '\n';
+            output << "BRDA:" << line << ",0,1," << ( hit ? ( branch_not_taken.test( addr ) ? "1" : "0" ) : "-" )
+                   << '\n';
+            branches_found += 2;
+            branches_hit += branch_taken.test( addr ) + branch_not_taken.test( addr );
+        }
+        output << "DA:" << line << ',' << ( hit ? 1 : 0 ) << '\n';
+        lines_found++;
+        lines_hit += hit;
+    }
+    output << "BRF:" << branches_found << "\nBRH:" << branches_hit << '\n';
+    output << "LF:" << lines_found << "\nLH:" << lines_hit << '\n';
+    output << "end_of_record\n";
+}
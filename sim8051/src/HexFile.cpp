@@ -0,0 +1,190 @@
+#include "sim8051/stdafx.hpp"
+#include "sim8051/HexFile.hpp"
+#include "sim8051/Encoding.hpp"
+
+#ifndef _WIN32
+#include <cerrno>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#ifndef _WIN32
+
+MappedFile::MappedFile( const String &path ) {
+    int fd = ::open( path.c_str(), O_RDONLY );
+    if ( fd < 0 )
+        return;
+    struct stat info;
+    if ( fstat( fd, &info ) != 0 ) {
+        close( fd );
+        return;
+    }
+    open = true;
+    if ( S_ISREG( info.st_mode ) && info.st_size > 0 ) {
+        size = info.st_size;
+        void *addr = mmap( nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0 );
+        if ( addr != MAP_FAILED ) {
+            madvise( addr, size, MADV_SEQUENTIAL );
+            data = static_cast<const char *>( addr );
+            mapped = true;
+        }
+    }
+    if ( !mapped ) {
+        // Pipes (e. g. "<(cat file)"), devices and files without a size (e. g. in /proc) are read to their end.
+        constexpr size_t chunk_size = 64 * 1024;
+        size_t used = 0;
+        while ( true ) {
+            buffer.resize( used + chunk_size );
+            ssize_t ret = read( fd, buffer.data() + used, chunk_size );
+            if ( ret < 0 && errno == EINTR )
+                continue;
+            if ( ret <= 0 ) {
+                open = ret == 0;
+                break;
+            }
+            used += ret;
+        }
+        buffer.resize( used );
+        data = buffer.data();
+        size = used;
+    }
+    close( fd );
+}
+
+MappedFile::~MappedFile() {
+    if ( mapped )
+        munmap( const_cast<char *>( data ), size );
+}
+
+#else
+
+MappedFile::MappedFile( const String &path ) {
+    std::ifstream stream( path, std::ios::binary );
+    if ( !stream.good() )
+        return;
+    buffer.assign( std::istreambuf_iterator<char>( stream ), std::istreambuf_iterator<char>() );
+    data = buffer.data();
+    size = buffer.size();
+    open = true;
+}
+
+MappedFile::~MappedFile() = default;
+
+#endif
+
+/// Values of the hexadecimal digits (-1 for other characters).
+constexpr std::array<i8, 256> make_hex_values() {
+    std::array<i8, 256> values = {};
+    for ( auto &value : values )
+        value = -1;
+    for ( int c = 0; c < 10; c++ )
+        values['0' + c] = c;
+    for ( int c = 0; c < 6; c++ ) {
+        values['a' + c] = 10 + c;
+        values['A' + c] = 10 + c;
+    }
+    return values;
+}
+
+constexpr std::array<i8, 256> hex_values = make_hex_values();
+
+bool parse_hex_image( std::string_view text, PagedMemory<64 * 1024> &memory, const String &name ) {
+    size_t line_no = 0;
+    size_t column = 0; // Of the current error (1-based).
+    auto error = [&]( const String &message ) {
+        log( LogLevel::error, name + ":" + to_string( line_no ) + ":" + to_string( column ) + ": " + message );
+        return false;
+    };
+
+    u32 base = 0; // Address of the segment (record 02) or linear address (record 04) of the following data.
+    for ( size_t pos = 0; pos < text.size(); ) {
+        size_t end = std::min( text.find( '\n', pos ), text.size() );
+        auto line = text.substr( pos, end - pos );
+        pos = end + 1;
+        line_no++;
+        while ( !line.empty() && ( line.back() == '\r' || line.back() == ' ' || line.back() == '\t' ) )
+            line.remove_suffix( 1 );
+
+        size_t start = line.find( ':' );
+        if ( start == line.npos ) {
+            if ( line.find_first_not_of( " \t" ) == line.npos )
+                continue;
+            column = 1;
+            return error( "Expected a record (starting with ':')" );
+        }
+
+        // Decode the bytes of the record.
+        auto record = line.substr( start + 1 );
+        std::array<u8, 5 + 255> bytes; // Size, address, type, data and checksum.
+        size_t count = std::min( record.size() / 2, bytes.size() );
+        for ( size_t i = 0; i < count; i++ ) {
+            i8 high = hex_values[static_cast<u8>( record[2 * i] )];
+            i8 low = hex_values[static_cast<u8>( record[2 * i + 1] )];
+            if ( high < 0 || low < 0 ) {
+                size_t digit = 2 * i + ( high < 0 ? 0 : 1 );
+                column = start + 2 + digit;
+                return error( "Invalid hexadecimal digit '" + String( 1, record[digit] ) + "'" );
+            }
+            bytes[i] = high << 4 | low;
+        }
+        column = start + 2;
+        if ( record.size() < 10 )
+            return error( "Record is too short" );
+        size_t size = bytes[0];
+        if ( record.size() != 2 * ( size + 5 ) )
+            return error( "Record has " + to_string( record.size() ) + " digits, but " + to_string( 2 * ( size + 5 ) ) +
+                          " are expected for " + to_string( size ) + " data bytes" );
+        u8 checksum = 0;
+        for ( size_t i = 0; i < size + 5; i++ )
+            checksum += bytes[i];
+        if ( checksum != 0 ) {
+            column = start + 2 + 2 * ( size + 4 );
+            return error( "Checksum error (expected " + to_hex_str( static_cast<u8>( bytes[size + 4] - checksum ) ) +
+                          ")" );
+        }
+
+        u16 addr = bytes[1] << 8 | bytes[2];
+        const u8 *data = bytes.data() + 4;
+        u8 type = bytes[3];
+        column = start + 8;
+        switch ( type ) {
+        case 0x00: // Data
+            for ( size_t i = 0; i < size; i++ ) {
+                u32 target = base + static_cast<u16>( addr + i ); // The offset wraps around within the segment.
+                if ( target >= memory.size() ) {
+                    column = start + 10 + 2 * i;
+                    return error( "Address " + to_hex_str( target >> 16 ) + to_hex_str( target & 0xFFFF, 16 ) +
+                                  " is outside of code memory" );
+                }
+                memory[target] = data[i];
+            }
+            break;
+        case 0x01: // End of file
+            if ( size != 0 )
+                return error( "End of file record with data" );
+            return true;
+        case 0x02: // Extended segment address
+        case 0x04: // Extended linear address
+            if ( size != 2 )
+                return error( "Address record needs 2 data bytes" );
+            base = ( data[0] << 8 | data[1] ) << ( type == 0x02 ? 4 : 16 );
+            break;
+        case 0x03: // Start segment address
+        case 0x05: // Start linear address
+            if ( size != 4 )
+                return error( "Start address record needs 4 data bytes" );
+            break;
+        default:
+            return error( "Unknown record type " + to_hex_str( type ) );
+        }
+    }
+
+    column = 1;
+    if ( line_no == 0 ) {
+        line_no = 1;
+        return error( "Empty file" );
+    }
+    return error( "Missing end of file record" );
+}
@@ -0,0 +1,23 @@
+#include "sim8051/stdafx.hpp"
+#include "sim8051/Instrumentation.hpp"
+
+size_t Instrumentation::add_observer( Observer observer ) {
+    flush(); // The new observer shouldn't get older events.
+    buffer.reserve( batch_size );
+    observers.emplace_back( next_id, std::move( observer ) );
+    return next_id++;
+}
+
+void Instrumentation::remove_observer( size_t id ) {
+    flush();
+    observers.erase( std::remove_if( observers.begin(), observers.end(), [&]( auto &o ) { return o.first == id; } ),
+                     observers.end() );
+}
+
+void Instrumentation::flush() {
+    if ( buffer.empty() )
+        return;
+    for ( auto &observer : observers )
+        observer.second( buffer.data(), buffer.size() );
+    buffer.clear();
+}
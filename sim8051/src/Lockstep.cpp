@@ -0,0 +1,124 @@
+#include "sim8051/stdafx.hpp"
+#include "sim8051/Lockstep.hpp"
+#include "sim8051/Encoding.hpp"
+
+/// Appends the differences of a memory (at most "max_count" entries). "name" returns the label of an index.
+template <size_t N>
+void diff_memory( String &ret, const std::array<u8, N> &reference, const std::array<u8, N> &candidate,
+                  const std::function<String( size_t )> &name, size_t max_count = 8 ) {
+    size_t count = 0;
+    for ( size_t i = 0; i < N; i++ ) {
+        if ( reference[i] == candidate[i] )
+            continue;
+        if ( count++ == max_count ) {
+            ret += "  ...\n";
+            break;
+        }
+        ret += "  " + name( i ) + ": " + to_hex_str( reference[i] ) + " != " + to_hex_str( candidate[i] ) + "\n";
+    }
+}
+
+String diff_state( const Processor &reference, const Processor &candidate ) {
+    String ret;
+    if ( reference.pc != candidate.pc )
+        ret += "  PC: " + to_hex_str( reference.pc, 16 ) + " != " + to_hex_str( candidate.pc, 16 ) + "\n";
+    if ( reference.cycle_count != candidate.cycle_count )
+        ret += "  Cycles: " + to_string( reference.cycle_count ) + " != " + to_string( candidate.cycle_count ) + "\n";
+    diff_memory( ret, reference.sfr, candidate.sfr, []( size_t i ) {
+        String name = sfr_name( i + 0x80 );
+        return name.empty() ? "SFR " + to_hex_str( i + 0x80 ) : name;
+    } );
+    u8 bank = reference.sfr[0xD0 - 0x80] & 0x18;
+    diff_memory( ret, reference.iram, candidate.iram, [&]( size_t i ) {
+        return i >= bank && i < bank + 8u ? "R" + to_string( i - bank ) : "IRAM " + to_hex_str( i );
+    } );
+    diff_memory( ret, reference.xram.bytes, candidate.xram.bytes,
+                 []( size_t i ) { return "XRAM " + to_hex_str( i, 16 ); } );
+    return ret;
+}
+
+/// Fast comparison of the architectural state (same parts as diff_state()).
+bool same_state( const Processor &reference, const Processor &candidate ) {
+    return reference.pc == candidate.pc && reference.cycle_count == candidate.cycle_count &&
+           reference.sfr == candidate.sfr && reference.iram == candidate.iram && reference.xram == candidate.xram;
+}
+
+std::optional<Divergence> run_lockstep( Processor &reference, Processor &candidate, const StepFunction &reference_step,
+                                        const StepFunction &candidate_step, size_t steps, size_t block_size,
+                                        std::array<size_t, 256> *executed_opcodes ) {
+    block_size = std::max<size_t>( block_size, 1 );
+    if ( !same_state( reference, candidate ) )
+        return Divergence{ 0, reference.pc, "(initial state)", diff_state( reference, candidate ) };
+
+    // States at the beginning of the current block (only needed to rewind blocks).
+    std::unique_ptr<Processor> reference_backup;
+    std::unique_ptr<Processor> candidate_backup;
+    for ( size_t done = 0; done < steps; ) {
+        size_t count = std::min( block_size, steps - done );
+        if ( count > 1 ) {
+            reference_backup = std::make_unique<Processor>( reference );
+            candidate_backup = std::make_unique<Processor>( candidate );
+        }
+        u16 last_pc = reference.pc;
+        for ( size_t i = 0; i < count; i++ ) {
+            last_pc = reference.pc;
+            if ( executed_opcodes )
+                ( *executed_opcodes )[reference.text[last_pc]]++;
+            reference_step( reference );
+            candidate_step( candidate );
+        }
+        if ( !same_state( reference, candidate ) ) {
+            if ( count == 1 ) {
+                // The operands are decoded with the state after the instruction, as there is no backup.
+                return Divergence{ done, last_pc, get_decoded_instruction_string( reference, last_pc ),
+                                   diff_state( reference, candidate ) };
+            }
+
+            // Find the first diverging step.
+            String block_diff = diff_state( reference, candidate );
+            reference = *reference_backup;
+            candidate = *candidate_backup;
+            for ( size_t i = 0; i < count; i++ ) {
+                u16 pc = reference.pc;
+                String instruction = get_decoded_instruction_string( reference, pc );
+                reference_step( reference );
+                candidate_step( candidate );
+                if ( !same_state( reference, candidate ) )
+                    return Divergence{ done + i, pc, instruction, diff_state( reference, candidate ) };
+            }
+            // An engine depends on something outside of the compared state.
+            return Divergence{ done, reference_backup->pc, "(not reproducible when stepping the block again)",
+                               block_diff };
+        }
+        done += count;
+    }
+    return std::nullopt;
+}
+
+void generate_random_program( Processor &processor, u32 seed ) {
+    std::mt19937 rng( seed );
+    auto random_byte = [&]() { return static_cast<u8>( rng() & 0xff ); };
+
+    processor.text.clear();
+    for ( size_t addr = 0; addr < processor.text.size(); ) {
+        u8 opcode;
+        do {
+            opcode = random_byte();
+        } while ( opcode == 0xA5 );
+        processor.text[addr++] = opcode;
+        for ( u8 i = 1; i < get_instruction_size( opcode ) && addr < processor.text.size(); i++ )
+            processor.text[addr++] = random_byte();
+    }
+
+    processor.full_reset();
+    for ( auto &byte : processor.iram )
+        byte = random_byte();
+    for ( auto &byte : processor.xram )
+        byte = random_byte();
+    for ( u8 addr : { 0xE0, 0xF0, 0xD0, 0x82, 0x83, 0x90, 0xA0 } )
+        processor.direct_acc( addr ) = random_byte();
+    // Keep interrupts and timers running sometimes, but never start in idle or power down mode.
+    processor.direct_acc( 0xA8 ) = random_byte() & 0x8f;
+    processor.direct_acc( 0x89 ) = random_byte();
+    processor.direct_acc( 0x88 ) = random_byte() & 0x55;
+}
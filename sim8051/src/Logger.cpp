@@ -0,0 +1,152 @@
+#include "sim8051/stdafx.hpp"
+#include "sim8051/Logger.hpp"
+
+std::atomic<Logger *> installed_logger{ nullptr };
+
+Logger::Logger( Sink sink ) : sink( std::move( sink ) ) {
+    for ( size_t i = 0; i < capacity; i++ )
+        slots[i].sequence.store( i, std::memory_order_relaxed );
+    thread = std::thread( [this] { run(); } );
+}
+
+Logger::~Logger() {
+    Logger *self = this;
+    installed_logger.compare_exchange_strong( self, nullptr );
+    stop.store( true, std::memory_order_release );
+    wake.notify_one();
+    thread.join();
+}
+
+void Logger::install() {
+    installed_logger.store( this, std::memory_order_release );
+}
+
+void Logger::push( LogLevel level, const String &message ) {
+    if ( level < min_level.load( std::memory_order_relaxed ) )
+        return;
+    bool limited = is_rate_limited( level );
+    if ( limited && !within_rate( true ) ) {
+        dropped.fetch_add( 1, std::memory_order_relaxed );
+        return;
+    }
+
+    // Claim a slot (bounded multi-producer queue, every slot knows the position it may be written at).
+    size_t position = write_position.load( std::memory_order_relaxed );
+    Slot *slot;
+    while ( true ) {
+        slot = &slots[position % capacity];
+        size_t sequence = slot->sequence.load( std::memory_order_acquire );
+        if ( sequence == position ) {
+            if ( write_position.compare_exchange_weak( position, position + 1, std::memory_order_relaxed ) )
+                break;
+        } else if ( sequence < position ) {
+            // Full
+            if ( limited ) {
+                dropped.fetch_add( 1, std::memory_order_relaxed );
+                return;
+            }
+            wake.notify_one();
+            std::this_thread::yield();
+            position = write_position.load( std::memory_order_relaxed );
+        } else {
+            position = write_position.load( std::memory_order_relaxed );
+        }
+    }
+    slot->level = level;
+    slot->message.assign( message );
+    slot->sequence.store( position + 1, std::memory_order_release );
+    if ( waiting.load( std::memory_order_relaxed ) )
+        wake.notify_one();
+}
+
+bool Logger::accepts( LogLevel level ) {
+    if ( level < min_level.load( std::memory_order_relaxed ) )
+        return false;
+    if ( is_rate_limited( level ) && !within_rate( false ) ) {
+        dropped.fetch_add( 1, std::memory_order_relaxed );
+        return false;
+    }
+    return true;
+}
+
+void Logger::flush() {
+    size_t end = write_position.load( std::memory_order_acquire );
+    while ( read_position.load( std::memory_order_acquire ) < end ) {
+        wake.notify_one();
+        std::this_thread::sleep_for( std::chrono::milliseconds( 1 ) );
+    }
+}
+
+bool Logger::is_rate_limited( LogLevel level ) {
+    return level == LogLevel::debug || level == LogLevel::warning;
+}
+
+bool Logger::within_rate( bool take ) {
+    i64 second = std::chrono::duration_cast<std::chrono::seconds>(
+                     std::chrono::steady_clock::now().time_since_epoch() )
+                     .count();
+    i64 current = rate_second.load( std::memory_order_relaxed );
+    if ( current != second && rate_second.compare_exchange_strong( current, second, std::memory_order_relaxed ) )
+        rate_count.store( 0, std::memory_order_relaxed );
+    if ( !take )
+        return rate_count.load( std::memory_order_relaxed ) < rate_limit;
+    return rate_count.fetch_add( 1, std::memory_order_relaxed ) < rate_limit;
+}
+
+void Logger::drain( bool final ) {
+    size_t position = read_position.load( std::memory_order_relaxed );
+    while ( true ) {
+        auto &slot = slots[position % capacity];
+        if ( slot.sequence.load( std::memory_order_acquire ) != position + 1 )
+            break;
+        sink( slot.level, slot.message );
+        slot.sequence.store( position + capacity, std::memory_order_release );
+        read_position.store( ++position, std::memory_order_release );
+    }
+
+    // Reported at most once per second, as messages may be dropped continuously.
+    auto now = std::chrono::steady_clock::now();
+    if ( !final && now - last_drop_report < std::chrono::seconds( 1 ) )
+        return;
+    size_t count = dropped.exchange( 0, std::memory_order_relaxed );
+    if ( count > 0 ) {
+        last_drop_report = now;
+        sink( LogLevel::warning, "Dropped " + to_string( count ) + " log messages (rate limit or full buffer)" );
+    }
+}
+
+void Logger::run() {
+    while ( true ) {
+        bool stopping = stop.load( std::memory_order_acquire );
+        drain( stopping );
+        if ( stopping )
+            return;
+
+        // Producers only notify while the thread is waiting. A notification which comes just before the wait is
+        // missed, which only delays the messages until the timeout.
+        std::unique_lock<std::mutex> lock( wake_mutex );
+        waiting.store( true, std::memory_order_relaxed );
+        wake.wait_for( lock, std::chrono::milliseconds( 20 ), [&] {
+            size_t position = read_position.load( std::memory_order_relaxed );
+            return stop.load( std::memory_order_acquire ) ||
+                   slots[position % capacity].sequence.load( std::memory_order_acquire ) == position + 1;
+        } );
+        waiting.store( false, std::memory_order_relaxed );
+    }
+}
+
+void log( const String &str ) {
+    log( LogLevel::info, str );
+}
+
+void log( LogLevel level, const String &str ) {
+    if ( auto *logger = installed_logger.load( std::memory_order_acquire ) )
+        logger->push( level, str );
+    else
+        std::cerr << str << '\n';
+}
+
+bool log_enabled( LogLevel level ) {
+    auto *logger = installed_logger.load( std::memory_order_acquire );
+    return !logger || logger->accepts( level );
+}
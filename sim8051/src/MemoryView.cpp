@@ -0,0 +1,56 @@
+#include "sim8051/stdafx.hpp"
+#include "sim8051/MemoryView.hpp"
+#include "sim8051/Encoding.hpp"
+
+MemoryView::MemoryView( size_t size )
+        : address_digits( size > 0x100 ? 4 : 2 ), bytes( size ), changed_at( size ), row_generations( size / row_size ),
+          text_generations( size / row_size ), texts( size / row_size ) {}
+
+void MemoryView::reset( const u8 *memory ) {
+    std::copy_n( memory, bytes.size(), bytes.begin() );
+    std::fill( changed_at.begin(), changed_at.end(), 0 );
+    std::fill( row_generations.begin(), row_generations.end(), 0 );
+    for ( auto &text : texts )
+        text.clear();
+    update_count = 0;
+}
+
+void MemoryView::update( const u8 *memory ) {
+    constexpr size_t block_size = 256; // Equal blocks are skipped with a single comparison.
+
+    update_count++;
+    for ( size_t block = 0; block < bytes.size(); block += block_size ) {
+        size_t block_end = std::min( block + block_size, bytes.size() );
+        if ( std::equal( bytes.begin() + block, bytes.begin() + block_end, memory + block ) )
+            continue;
+        for ( size_t row = block / row_size; row < block_end / row_size; row++ ) {
+            for ( size_t addr = row * row_size; addr < ( row + 1 ) * row_size; addr++ ) {
+                if ( bytes[addr] != memory[addr] ) {
+                    bytes[addr] = memory[addr];
+                    changed_at[addr] = update_count;
+                    row_generations[row] = update_count;
+                }
+            }
+        }
+    }
+}
+
+const String &MemoryView::row_text( size_t row ) {
+    auto &text = texts[row];
+    if ( !text.empty() && text_generations[row] == row_generations[row] )
+        return text;
+
+    // "Addr " address ": " (" " byte)... "  |  " ascii...
+    text.assign( byte_offset( row_size ) + 5 + row_size, ' ' );
+    std::copy_n( "Addr ", 5, text.begin() );
+    write_hex( &text[5], row * row_size, address_digits );
+    text[5 + address_digits] = ':';
+    text[byte_offset( row_size ) + 2] = '|';
+    for ( size_t column = 0; column < row_size; column++ ) {
+        u8 byte = bytes[row * row_size + column];
+        write_hex( &text[byte_offset( column ) + 1], byte, 2 );
+        text[byte_offset( row_size ) + 5 + column] = byte < ' ' || byte >= 0x7f ? '.' : static_cast<char>( byte );
+    }
+    text_generations[row] = row_generations[row];
+    return text;
+}
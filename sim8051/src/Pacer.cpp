@@ -0,0 +1,51 @@
+#include "sim8051/stdafx.hpp"
+#include "sim8051/Pacer.hpp"
+
+void Pacer::start( size_t cycle_count ) {
+    start_time = stats_time = Clock::now();
+    start_cycle = stats_cycle = next_wait_cycle = cycle_count;
+    worst_lag = 0;
+    restarts = 0;
+}
+
+size_t Pacer::target_cycle() const {
+    f64 elapsed = std::chrono::duration<f64>( Clock::now() - start_time ).count();
+    return start_cycle + static_cast<size_t>( elapsed * cycles_per_second() );
+}
+
+void Pacer::check_lag( size_t cycle_count ) {
+    auto now = Clock::now();
+    f64 lag = std::chrono::duration<f64>( now - due_time( cycle_count ) ).count();
+    worst_lag = std::max( worst_lag, lag );
+    if ( lag > max_lag ) {
+        // Too slow (or interrupted by the host): continue from here.
+        start_time = now;
+        start_cycle = cycle_count;
+        restarts++;
+    }
+}
+
+void Pacer::wait_until( size_t cycle_count ) {
+    auto due = due_time( cycle_count );
+    auto now = Clock::now();
+    if ( now >= due ) {
+        check_lag( cycle_count );
+    } else {
+        if ( due - now > spin_time )
+            std::this_thread::sleep_until( due - spin_time );
+        while ( Clock::now() < due ) {
+        }
+    }
+    next_wait_cycle = cycle_count + std::max<size_t>( 1, cycles_per_second() / 1000 );
+}
+
+f64 Pacer::achieved_ratio( size_t cycle_count ) const {
+    f64 host_seconds = std::chrono::duration<f64>( Clock::now() - stats_time ).count();
+    f64 simulated_seconds = ( cycle_count - stats_cycle ) * 12 / oscillator_hz;
+    return host_seconds > 0 ? simulated_seconds / host_seconds : 0;
+}
+
+Pacer::Clock::time_point Pacer::due_time( size_t cycle_count ) const {
+    f64 seconds = ( static_cast<f64>( cycle_count ) - start_cycle ) / cycles_per_second();
+    return start_time + std::chrono::duration_cast<Clock::duration>( std::chrono::duration<f64>( seconds ) );
+}
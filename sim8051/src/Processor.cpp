@@ -1,5 +1,8 @@
 #include "sim8051/stdafx.hpp"
 #include "sim8051/Processor.hpp"
+#include "sim8051/HexFile.hpp"
+#include "sim8051/InstructionSet.hpp"
+#include "sim8051/Profiler.hpp"
 
 constexpr std::array<u8, 24> valid_sfr_addresses = { 0xE0, 0xF0, 0xD0, 0xB8, 0xA8, 0x82, 0x83, 0x80,
                                                      0x90, 0xA0, 0xB0, 0x87, 0x98, 0x99, 0x88, 0xC8,
@@ -12,7 +15,10 @@ u8 &Processor::direct_acc( u8 addr ) {
         if ( std::find( valid_sfr_addresses.begin(), valid_sfr_addresses.end(), addr ) != valid_sfr_addresses.end() ) {
             return sfr[addr - 0x80];
         } else {
-            log( "Invalid access to sfr at address " + to_string( addr ) + ", PC: " + to_string( pc ) );
+            anomalies.record( Anomaly::invalid_sfr, pc, cycle_count );
+            if ( log_enabled( LogLevel::warning ) )
+                log( LogLevel::warning,
+                     "Invalid access to sfr at address " + to_string( addr ) + ", PC: " + to_string( pc ) );
             invalid_byte = 0;
             return invalid_byte;
         }
@@ -41,61 +47,337 @@ void Processor::set_bit_to( u8 bit_addr, bool value ) {
     }
 }
 
+bool Breakpoints::set( MemSpace space, Kind kind, u16 addr, bool enable ) {
+    if ( space == MemSpace::code && kind == execute ) {
+        code_execute.set_to( addr, enable );
+        if ( !enable )
+            options.erase( addr );
+    } else if ( space == MemSpace::code && kind == read ) {
+        code_read.set_to( addr, enable );
+    } else if ( space == MemSpace::iram && kind != execute ) {
+        ( kind == read ? iram_read : iram_write ).set_to( addr & 0xff, enable );
+    } else if ( space == MemSpace::sfr && kind != execute ) {
+        ( kind == read ? sfr_read : sfr_write ).set_to( addr & 0x7f, enable );
+    } else if ( space == MemSpace::xram && kind != execute ) {
+        ( kind == read ? xram_read : xram_write ).set_to( addr, enable );
+    } else {
+        return false;
+    }
+
+    armed = ( code_execute.any() ? execute : 0 ) |
+            ( code_read.any() || iram_read.any() || sfr_read.any() || xram_read.any() ? read : 0 ) |
+            ( iram_write.any() || sfr_write.any() || xram_write.any() ? write : 0 );
+    return true;
+}
+
+bool Breakpoints::set_conditional( u16 addr, const String &expression, size_t ignore_count ) {
+    BreakpointOptions opts;
+    if ( !compile_condition( expression, opts.condition ) )
+        return false;
+    opts.expression = expression;
+    opts.ignore_count = ignore_count;
+    set( MemSpace::code, execute, addr, true );
+    options[addr] = std::move( opts );
+    return true;
+}
+
+void Breakpoints::clear() {
+    options.clear();
+    code_execute.reset();
+    code_read.reset();
+    iram_read.reset();
+    iram_write.reset();
+    sfr_read.reset();
+    sfr_write.reset();
+    xram_read.reset();
+    xram_write.reset();
+    armed = 0;
+}
+
+void Breakpoints::for_each( const std::function<void( MemSpace, Kind, u16 )> &func ) const {
+    auto iterate = [&]( const auto &bitmap, MemSpace space, Kind kind, u16 offset ) {
+        for ( size_t i = 0; i < bitmap.bit_count; i++ ) {
+            if ( bitmap.words[i >> 6] == 0 )
+                i |= 63; // Skip empty words.
+            else if ( bitmap.test( i ) )
+                func( space, kind, i + offset );
+        }
+    };
+    iterate( code_execute, MemSpace::code, execute, 0 );
+    iterate( code_read, MemSpace::code, read, 0 );
+    iterate( iram_read, MemSpace::iram, read, 0 );
+    iterate( iram_write, MemSpace::iram, write, 0 );
+    iterate( sfr_read, MemSpace::sfr, read, 0x80 );
+    iterate( sfr_write, MemSpace::sfr, write, 0x80 );
+    iterate( xram_read, MemSpace::xram, read, 0 );
+    iterate( xram_write, MemSpace::xram, write, 0 );
+}
+
+/// Returns the address space of a direct address.
+MemSpace direct_space( u8 addr ) {
+    return addr < 0x80 ? MemSpace::iram : MemSpace::sfr;
+}
+
+/// Returns the direct address of the byte which contains a bit.
+u8 bit_byte_addr( u8 bit_addr ) {
+    return bit_addr < 0x80 ? 0x20 + ( bit_addr >> 3 ) : bit_addr & 0b11111000;
+}
+
+/// Returns the byte at an address of an address space.
+u8 mem_value( const Processor &processor, MemSpace space, u16 addr ) {
+    switch ( space ) {
+    case MemSpace::code:
+        return processor.text[addr];
+    case MemSpace::iram:
+        return processor.iram[addr & 0xff];
+    case MemSpace::sfr:
+        return processor.sfr[addr & 0x7f];
+    case MemSpace::xram:
+        return processor.xram[addr];
+    }
+    return 0;
+}
+
+template <bool tracked>
+void Processor::note_read( MemSpace space, u16 addr ) {
+    if constexpr ( tracked ) {
+        if ( ( breakpoints.armed & Breakpoints::read ) && breakpoints.test( space, Breakpoints::read, addr ) )
+            watch_hit = MemAccess{ space, addr, false };
+        note_event<tracked>( Event::read, space, addr, mem_value( *this, space, addr ) );
+    }
+}
+
+template <bool tracked>
+void Processor::note_write( MemSpace space, u16 addr ) {
+    if constexpr ( tracked ) {
+        if ( ( breakpoints.armed & Breakpoints::write ) && breakpoints.test( space, Breakpoints::write, addr ) )
+            watch_hit = MemAccess{ space, addr, true };
+        note_event<tracked>( Event::write, space, addr, mem_value( *this, space, addr ) );
+    }
+    if ( space == MemSpace::sfr && addr == 0x99 )
+        serial_transmit(); // Writing SBUF starts a transmission.
+}
+
+template <bool tracked>
+void Processor::note_event( Event::Kind kind, MemSpace space, u16 addr, u8 value ) {
+    if constexpr ( tracked ) {
+        if ( instrumentation.active() )
+            instrumentation.record( { kind, space, value, addr, cycle_count } );
+    }
+}
+
 bool Processor::load_hex_code( const String &file ) {
     // Clear state
-    text.fill( 0 );
+    text.clear();
+    coverage.clear();
+    symbols.clear();
     reset();
 
-    // Open file
-    std::ifstream stream( file );
-    if ( !stream.good() ) {
-        log( "Failed to load hex file!" );
+    MappedFile mapped( file );
+    if ( !mapped.is_open() ) {
+        log( LogLevel::error, "Failed to load hex file!" );
         return false;
     }
+    auto content = mapped.content();
+    if ( std::filesystem::path( file ).extension() != ".bin" )
+        return parse_hex_image( content, text, file );
 
+    // Raw binary image from address 0
+    if ( content.size() > text.size() ) {
+        log( LogLevel::error,
+             file + ": Image doesn't fit into code memory (" + to_string( content.size() ) + " bytes)" );
+        return false;
+    }
+    for ( size_t addr = 0; addr < content.size(); addr++ )
+        text[addr] = content[addr];
+    return true;
+}
+
+bool Processor::load_hex_code( std::istream &stream ) {
+    // Clear state
+    text.clear();
+    coverage.clear();
+    symbols.clear();
+    reset();
 
-    // Load file
-    String str;
-    size_t line_ctr = 0;
-    while ( std::getline( stream, str ) ) {
-        u8 checksum = 0;
-        line_ctr++;
+    String content( std::istreambuf_iterator<char>( stream ), std::istreambuf_iterator<char>{} );
+    return parse_hex_image( content, text, "<stream>" );
+}
 
-        if ( str.find( ':' ) == str.npos ) {
-            log( "Synatax error at line " + to_string( line_ctr ) );
-            return false;
-        }
-        str = str.substr( str.find( ':' ) ); // Ignore leading text.
-
-        if ( str.substr( 7, 2 ) == "00" ) {
-            // Normal data line.
-            size_t size = stoi( str.substr( 1, 2 ), 0, 16 );
-            size_t addr = stoi( str.substr( 3, 4 ), 0, 16 );
-            checksum += size + ( addr & 0xff ) + ( addr >> 8 );
-            for ( size_t i = 0; i < size; i++ ) {
-                u8 byte = stoi( str.substr( 9 + i * 2, 2 ), 0, 16 );
-                text[addr + i] = byte;
-                checksum += byte;
-            }
-            if ( static_cast<u8>( checksum + stoi( str.substr( 9 + size * 2, 2 ), 0, 16 ) ) != 0 ) {
-                log( "Checksum error at line " + to_string( line_ctr ) );
-                return false;
-            }
-        } else if ( str.substr( 7, 2 ) == "01" ) {
-            // End line
-            if ( str != ":00000001FF" && str != ":00000001ff" ) {
-                log( "Syntax error at termination line " + to_string( line_ctr ) );
-                return false;
+bool Processor::load_code( const std::vector<u8> &code ) {
+    text.clear();
+    coverage.clear();
+    symbols.clear();
+    reset();
+    if ( code.size() > text.size() ) {
+        log( LogLevel::error, "Code doesn't fit into code memory (" + to_string( code.size() ) + " bytes)" );
+        return false;
+    }
+    for ( size_t addr = 0; addr < code.size(); addr++ )
+        text[addr] = code[addr];
+    return true;
+}
+
+bool Processor::evaluate( const Condition &condition ) {
+    if ( condition.code.empty() )
+        return true;
+
+    std::array<i64, Condition::max_stack_size + 1> stack;
+    size_t top = 0; // Number of values on the stack.
+    for ( auto &instr : condition.code ) {
+        i64 &lhs = stack[top >= 2 ? top - 2 : 0];
+        i64 rhs = top >= 1 ? stack[top - 1] : 0;
+        switch ( instr.op ) {
+        case Condition::push:
+            stack[top++] = instr.arg;
+            break;
+        case Condition::load_direct:
+            stack[top++] = direct_acc( instr.arg );
+            break;
+        case Condition::load_bit:
+            stack[top++] = is_bit_set( instr.arg );
+            break;
+        case Condition::load_reg:
+            stack[top++] = iram[( direct_acc( 0xD0 ) & 0x18 ) + instr.arg];
+            break;
+        case Condition::load_iram:
+            stack[top - 1] = iram[static_cast<u8>( rhs )];
+            break;
+        case Condition::load_xram:
+            stack[top - 1] = std::as_const( xram )[static_cast<u16>( rhs )];
+            break;
+        case Condition::load_code:
+            stack[top - 1] = std::as_const( text )[static_cast<u16>( rhs )];
+            break;
+        case Condition::load_pc:
+            stack[top++] = pc;
+            break;
+        case Condition::load_dptr:
+            stack[top++] = ( static_cast<u16>( direct_acc( 0x83 ) ) << 8 ) | direct_acc( 0x82 );
+            break;
+        case Condition::load_cycles:
+            stack[top++] = cycle_count;
+            break;
+        case Condition::negate:
+            stack[top - 1] = -rhs;
+            break;
+        case Condition::logical_not:
+            stack[top - 1] = !rhs;
+            break;
+        case Condition::bitwise_not:
+            stack[top - 1] = ~rhs;
+            break;
+        default:
+            // Binary operators
+            switch ( instr.op ) {
+            case Condition::mul:
+                lhs *= rhs;
+                break;
+            case Condition::add:
+                lhs += rhs;
+                break;
+            case Condition::sub:
+                lhs -= rhs;
+                break;
+            case Condition::bitwise_and:
+                lhs &= rhs;
+                break;
+            case Condition::bitwise_xor:
+                lhs ^= rhs;
+                break;
+            case Condition::bitwise_or:
+                lhs |= rhs;
+                break;
+            case Condition::eq:
+                lhs = lhs == rhs;
+                break;
+            case Condition::ne:
+                lhs = lhs != rhs;
+                break;
+            case Condition::lt:
+                lhs = lhs < rhs;
+                break;
+            case Condition::le:
+                lhs = lhs <= rhs;
+                break;
+            case Condition::gt:
+                lhs = lhs > rhs;
+                break;
+            case Condition::ge:
+                lhs = lhs >= rhs;
+                break;
+            case Condition::logical_and:
+                lhs = lhs && rhs;
+                break;
+            case Condition::logical_or:
+                lhs = lhs || rhs;
+                break;
+            default:
+                break;
             }
-            return true;
+            top--;
+            break;
         }
     }
+    return top > 0 && stack[top - 1] != 0;
+}
+
+/// Returns whether an execution breakpoint at the address should break now (checks conditions and hit counts).
+bool Processor::break_here( u16 addr ) {
+    auto itr = breakpoints.options.find( addr );
+    if ( itr == breakpoints.options.end() )
+        return true;
+    auto &opts = itr->second;
+    if ( !evaluate( opts.condition ) )
+        return false;
+    opts.hit_count++;
+    return opts.hit_count > opts.ignore_count;
+}
+
+void Processor::shadow_return( u8 sp ) {
+    // Frames above the stack pointer were abandoned (e. g. by popping the return address), so they are dropped too.
+    // Returns through manually pushed addresses (sp above all frames) are just jumps and keep the stack.
+    while ( !shadow_stack.empty() && shadow_stack.back().sp >= sp )
+        shadow_stack.pop_back();
+}
+
+bool Processor::step_finished() const {
+    switch ( step_mode ) {
+    case StepMode::over:
+        return step_executed && shadow_stack.size() <= step_depth;
+    case StepMode::out:
+        return shadow_stack.size() < step_depth;
+    case StepMode::run_to:
+        return pc == step_target;
+    default:
+        return false;
+    }
+}
+
+void Processor::step_over() {
+    step_mode = StepMode::over;
+    step_depth = shadow_stack.size();
+    step_executed = false;
+}
+
+bool Processor::step_out() {
+    if ( shadow_stack.empty() ) {
+        log( "Can't step out: not in a subroutine or interrupt" );
+        return false;
+    }
+    step_mode = StepMode::out;
+    step_depth = shadow_stack.size();
+    return true;
+}
 
-    log( "File not terminated properly!" );
-    return false;
+void Processor::run_to( u16 addr ) {
+    step_mode = StepMode::run_to;
+    step_target = addr;
 }
 
 void Processor::reset() {
+    shadow_stack.clear();
+    step_mode = StepMode::none;
     timer_0_in_mem = false;
     timer_1_in_mem = false;
     int0_in_mem = false;
@@ -104,6 +386,7 @@ void Processor::reset() {
     is_in_high_prio_intr = false;
     was_in_interrupt = false;
 
+    serial.reset();
     sfr.fill( 0 );
     pc = 0;
     direct_acc( 0x80 ) = 0xff;
@@ -113,11 +396,86 @@ void Processor::reset() {
     direct_acc( 0x81 ) = 0x07;
 }
 
+void Processor::restore( const Processor &snapshot ) {
+    timer_0_in_mem = snapshot.timer_0_in_mem;
+    timer_1_in_mem = snapshot.timer_1_in_mem;
+    int0_in_mem = snapshot.int0_in_mem;
+    int1_in_mem = snapshot.int1_in_mem;
+    is_in_interrupt = snapshot.is_in_interrupt;
+    is_in_high_prio_intr = snapshot.is_in_high_prio_intr;
+    was_in_interrupt = snapshot.was_in_interrupt;
+    step_mode = StepMode::none;
+
+    sfr = snapshot.sfr;
+    iram = snapshot.iram;
+    xram = snapshot.xram;
+    text = snapshot.text;
+    pc = snapshot.pc;
+    cycle_count = snapshot.cycle_count;
+    shadow_stack = snapshot.shadow_stack;
+    serial.restore( snapshot.serial );
+    anomalies = snapshot.anomalies;
+    stats = snapshot.stats;
+}
+
+void Processor::serial_transmit() {
+    auto &sbuf = direct_acc( 0x99 );
+    u8 scon = direct_acc( 0x98 );
+    bool bit8 = ( scon >> 6 ) >= 2 && ( scon & 0x08 ); // TB8 in modes 2 and 3
+    serial.transmit_frame = sbuf | ( bit8 ? 0x100 : 0 );
+    serial.transmit_ticks = SerialPort::frame_ticks( scon, direct_acc( 0x87 ) );
+    sbuf = serial.receive_buffer; // Reading SBUF returns the receive buffer.
+}
+
+void Processor::serial_cycle( u8 cycles, u8 timer1_overflows ) {
+    constexpr u8 scon_ri = 0x98; // Address of the RI bit of SCON.
+    constexpr u8 scon_ti = 0x99; // Address of the TI bit of SCON.
+    constexpr u8 scon_rb8 = 0x9A; // Address of the RB8 bit of SCON.
+    constexpr u8 scon_ren = 0x9C; // Address of the REN bit of SCON.
+    constexpr u8 scon_sm2 = 0x9D; // Address of the SM2 bit of SCON.
+
+    u8 scon = direct_acc( 0x98 );
+    u8 mode = scon >> 6;
+    u32 elapsed = mode == 0 || mode == 2 ? 12u * cycles : timer1_overflows; // See SerialPort::frame_ticks().
+
+    if ( serial.transmit_ticks != 0 ) {
+        serial.transmit_ticks -= std::min( serial.transmit_ticks, elapsed );
+        if ( serial.transmit_ticks == 0 ) {
+            set_bit_to( scon_ti, true );
+            if ( serial.transmit )
+                serial.transmit( serial.transmit_frame & 0xff, serial.transmit_frame & 0x100 );
+        }
+    }
+
+    if ( serial.receive_ticks == 0 ) {
+        // A frame starts with its start bit. Mode 0 only shifts in data while RI is cleared.
+        if ( is_bit_set( scon_ren ) && !serial.input.empty() && ( mode != 0 || !is_bit_set( scon_ri ) ) ) {
+            serial.receive_frame = serial.input.front();
+            serial.input.pop_front();
+            serial.receive_ticks = SerialPort::frame_ticks( scon, direct_acc( 0x87 ) );
+        }
+    } else {
+        serial.receive_ticks -= std::min( serial.receive_ticks, elapsed );
+        bool bit8 = serial.receive_frame & 0x100;
+        // The frame is lost if the previous one wasn't read yet. With SM2 set only frames with bit 8 are accepted.
+        if ( serial.receive_ticks == 0 && !is_bit_set( scon_ri ) &&
+             ( mode == 0 || !is_bit_set( scon_sm2 ) || bit8 ) ) {
+            serial.receive_buffer = serial.receive_frame & 0xff;
+            direct_acc( 0x99 ) = serial.receive_buffer;
+            if ( mode != 0 )
+                set_bit_to( scon_rb8, bit8 );
+            set_bit_to( scon_ri, true );
+        }
+    }
+}
+
 void Processor::full_reset() {
     reset();
     iram.fill( 0 );
-    xram.fill( 0 );
+    xram.clear();
     cycle_count = 0;
+    anomalies.clear();
+    stats.clear( 0 );
 }
 
 bool parity_of_byte( u8 byte ) {
@@ -130,6 +488,18 @@ bool parity_of_byte( u8 byte ) {
 }
 
 void Processor::do_cycle() {
+    // Memory accesses are only tracked while watchpoints are armed or observers are registered.
+    if ( ( breakpoints.armed & ( Breakpoints::read | Breakpoints::write ) ) || instrumentation.active() ) {
+        do_cycle_impl<true>();
+    } else {
+        do_cycle_impl<false>();
+    }
+}
+
+template <bool tracked>
+void Processor::do_cycle_impl() {
+    ProfileZone zone( Zone::interrupts ); // Switched to the following phases (compiled out in release builds).
+
     // Common constants
     constexpr u8 parity_addr = 0xD0; // Address of parity bit.
     constexpr u8 overflow_addr = 0xD2; // Address of overflow flag.
@@ -145,10 +515,12 @@ void Processor::do_cycle() {
     constexpr u8 p3_rd = 0xB7; // Address of the RD bit of P3.
 
     constexpr u8 ie_ea = 0xAF; // Address of the EA bit of IE.
+    constexpr u8 ie_es = 0xAC; // Address of the ES bit of IE.
     constexpr u8 ie_et1 = 0xAB; // Address of the ET1 bit of IE.
     constexpr u8 ie_ex1 = 0xAA; // Address of the EX1 bit of IE.
     constexpr u8 ie_et0 = 0xA9; // Address of the ET0 bit of IE.
     constexpr u8 ie_ex0 = 0xA8; // Address of the EX0 bit of IE.
+    constexpr u8 ip_ps = 0xBC; // Address of the PS bit of IP.
     constexpr u8 ip_pt1 = 0xBB; // Address of the PT1 bit of IP.
     constexpr u8 ip_px1 = 0xBA; // Address of the PX1 bit of IP.
     constexpr u8 ip_pt0 = 0xB9; // Address of the PT0 bit of IP.
@@ -161,6 +533,8 @@ void Processor::do_cycle() {
     constexpr u8 tcon_it1 = 0x8A; // Address of the IT1 bit of TCON.
     constexpr u8 tcon_ie0 = 0x89; // Address of the IE0 bit of TCON.
     constexpr u8 tcon_it0 = 0x88; // Address of the IT0 bit of TCON.
+    constexpr u8 scon_ti = 0x99; // Address of the TI bit of SCON.
+    constexpr u8 scon_ri = 0x98; // Address of the RI bit of SCON.
 
     // SFRs
     auto &a = direct_acc( 0xE0 );
@@ -181,6 +555,7 @@ void Processor::do_cycle() {
     auto &tl1 = direct_acc( 0x9B );
     auto &th0 = direct_acc( 0x9C );
     auto &th1 = direct_acc( 0x9D );
+    auto &scon = direct_acc( 0x98 );
     auto &sp = direct_acc( 0x81 );
 
     auto bank_nr = ( psw & 0x18 ) >> 3;
@@ -198,11 +573,13 @@ void Processor::do_cycle() {
     bool bit = false;
     i16 result;
     u16 inc_pc = 1;
-    u8 inc_cycle = 2;
+    u8 inc_cycle = 2; // Of an interrupt entry, instructions take the cycles of instruction_set.
     u16 generate_jump_to = 0; // 0 means no jump
+    i8 branch_outcome = -1; // Result of a conditional branch (-1: no conditional branch, 0: fell through, 1: jumped).
 
     // Check for power down mode.
     if ( pcon & 2 ) {
+        stats.power_down_steps++;
         return; // No operations while powered down.
     }
 
@@ -256,6 +633,12 @@ void Processor::do_cycle() {
             is_in_high_prio_intr = is_bit_set( ip_pt1 );
             generate_jump_to = 0x1B;
             set_bit_to( tcon_tf1, 0 ); // Clear flag
+        } else if ( ( is_bit_set( scon_ri ) || is_bit_set( scon_ti ) ) && is_bit_set( ie_es ) &&
+                    ( !is_in_interrupt || is_bit_set( ip_ps ) ) ) {
+            // Trigger serial interrupt (the flags are cleared by software)
+            is_in_interrupt = true;
+            is_in_high_prio_intr = is_bit_set( ip_ps );
+            generate_jump_to = 0x23;
         }
     }
     if ( was_in_interrupt )
@@ -267,8 +650,13 @@ void Processor::do_cycle() {
         // Basically a lcall
         sp++;
         iram[sp] = pc & 0xff;
+        note_write<tracked>( MemSpace::iram, sp );
         sp++;
         iram[sp] = ( pc & 0xff00 ) >> 8;
+        note_write<tracked>( MemSpace::iram, sp );
+        shadow_stack.push_back( { pc, sp, true } );
+        note_event<tracked>( Event::interrupt_entry, MemSpace::code, generate_jump_to, is_in_high_prio_intr );
+        stats.count_interrupt( generate_jump_to );
         pc = generate_jump_to;
         inc_pc = 0;
 
@@ -278,15 +666,25 @@ void Processor::do_cycle() {
         }
     } else if ( !( pcon & 1 ) ) {
         // Execute the instruction (if not in idle).
-        u8 instr = text[pc];
-        u8 arg1 = text[pc + (u16) 1];
-        u8 arg2 = text[pc + (u16) 2];
+        zone.next( Zone::dispatch );
+        if ( step_mode == StepMode::over && shadow_stack.size() <= step_depth )
+            step_executed = true;
+        u16 instr_addr = pc;
+        auto &code = std::as_const( text );
+        u8 instr = code[pc];
+        inc_cycle = instruction_set[instr].cycles;
+        stats.opcodes[instr]++;
+        note_event<tracked>( Event::fetch, MemSpace::code, pc, instr );
+        u8 arg1 = code[pc + (u16) 1];
+        u8 arg2 = code[pc + (u16) 2];
         u8 ls_nibble = instr & 0xf;
         u8 ms_nibble = ( instr & 0xf0 ) >> 4;
         if ( ls_nibble > 3 ) {
             // Regular instruction
             u8 *value;
             u8 *second_operand;
+            MemSpace value_space = MemSpace::iram; // Location of the operand (only used if it's not immediate).
+            u16 value_addr = 0;
             if ( ls_nibble == 4 ) {
                 // Immediate
                 value = &arg1;
@@ -297,18 +695,35 @@ void Processor::do_cycle() {
                 value = &direct_acc( arg1 );
                 second_operand = &arg2;
                 inc_pc = 2;
+                value_space = direct_space( arg1 );
+                value_addr = arg1;
             } else if ( ls_nibble == 6 ) {
                 // Indirect R0 access
                 value = &iram[r0];
                 second_operand = &arg1;
+                value_addr = r0;
             } else if ( ls_nibble == 7 ) {
                 // Indirect R1 access
                 value = &iram[r1];
                 second_operand = &arg1;
+                value_addr = r1;
             } else {
                 // Register
                 value = r0_ptr + ls_nibble - 8;
                 second_operand = &arg1;
+                value_addr = 8 * bank_nr + ls_nibble - 8;
+            }
+            // Classify accesses of the operand (immediate values are not in memory). Writes are always reported,
+            // because writing SBUF starts a transmission.
+            bool writes_value = ls_nibble != 4 && ( ms_nibble <= 0x1 || ms_nibble == 0x7 ||
+                                                    ( ms_nibble == 0xA && ls_nibble != 5 ) || ms_nibble == 0xC ||
+                                                    ms_nibble == 0xD || ms_nibble == 0xF );
+            if constexpr ( tracked ) {
+                bool reads_value = ls_nibble != 4 && ms_nibble != 0x7 && ms_nibble != 0xA && ms_nibble != 0xF;
+                if ( reads_value )
+                    note_read<tracked>( value_space, value_addr );
+                if ( ms_nibble == 0xA && ls_nibble != 4 && ls_nibble != 5 )
+                    note_read<tracked>( direct_space( arg1 ), arg1 ); // MOV operand,direct
             }
 
             // Process the instruction
@@ -321,7 +736,6 @@ void Processor::do_cycle() {
                 } else {
                     ( *value )++;
                 }
-                inc_cycle = 1;
                 break;
             case 0x1: // DEC operand
                 if ( ls_nibble == 4 ) {
@@ -331,7 +745,6 @@ void Processor::do_cycle() {
                 } else {
                     ( *value )--;
                 }
-                inc_cycle = 1;
                 break;
             case 0x2: // ADD A,operand
                 result = static_cast<i16>( a ) + static_cast<i16>( *value );
@@ -340,7 +753,6 @@ void Processor::do_cycle() {
                 set_bit_to( auxilary_addr, ( a & 0b1000 ) == 1 && ( static_cast<u8>( result ) & 0b1000 ) == 0 );
                 a = result;
                 set_bit_to( parity_addr, parity_of_byte( a ) );
-                inc_cycle = 1;
                 break;
             case 0x3: // ADDC A,operand
                 result = static_cast<i16>( a ) + static_cast<i16>( *value ) + ( is_bit_set( carry_addr ) ? 1 : 0 );
@@ -349,22 +761,18 @@ void Processor::do_cycle() {
                 set_bit_to( auxilary_addr, ( a & 0b1000 ) == 1 && ( static_cast<u8>( result ) & 0b1000 ) == 0 );
                 a = result;
                 set_bit_to( parity_addr, parity_of_byte( a ) );
-                inc_cycle = 1;
                 break;
             case 0x4: // ORL A,operand
                 a |= *value;
                 set_bit_to( parity_addr, parity_of_byte( a ) );
-                inc_cycle = 1;
                 break;
             case 0x5: // ANL A,operand
                 a &= *value;
                 set_bit_to( parity_addr, parity_of_byte( a ) );
-                inc_cycle = 1;
                 break;
             case 0x6: // XRL A,operand
                 a ^= *value;
                 set_bit_to( parity_addr, parity_of_byte( a ) );
-                inc_cycle = 1;
                 break;
             case 0x7: // MOV operand,#data
                 if ( ls_nibble == 4 ) {
@@ -374,25 +782,24 @@ void Processor::do_cycle() {
                     *value = *second_operand;
                     inc_pc++;
                 }
-                if ( ls_nibble != 5 )
-                    inc_cycle = 1;
                 break;
             case 0x8: // MOV address,operand
                 if ( ls_nibble == 4 ) {
                     // Actually encodes division
                     set_bit_to( carry_addr, false );
                     if ( b == 0 ) {
-                        log( "Division by zero!" );
+                        anomalies.record( Anomaly::division_by_zero, pc, cycle_count );
+                        if ( log_enabled( LogLevel::warning ) )
+                            log( LogLevel::warning, "Division by zero!" );
                         set_bit_to( overflow_addr, true );
                     } else {
-                        auto rem = a - a / b;
+                        auto rem = a % b;
                         a = a / b;
                         b = rem;
                         set_bit_to( overflow_addr, false );
                         set_bit_to( parity_addr, parity_of_byte( a ) );
                     }
                     inc_pc = 1;
-                    inc_cycle = 4;
                 } else if ( ls_nibble == 5 ) {
                     direct_acc( arg2 ) = *value; // Swapped parameters!
                     inc_pc = 3;
@@ -408,7 +815,6 @@ void Processor::do_cycle() {
                 set_bit_to( auxilary_addr, ( a & 0b1000 ) == 1 && ( static_cast<u8>( result ) & 0b1000 ) == 0 );
                 a = result;
                 set_bit_to( parity_addr, parity_of_byte( a ) );
-                inc_cycle = 1;
                 break;
             case 0xA: // MOV operand,address
                 if ( ls_nibble == 4 ) {
@@ -420,12 +826,12 @@ void Processor::do_cycle() {
                     set_bit_to( overflow_addr, prod > 0xff );
                     set_bit_to( parity_addr, parity_of_byte( a ) );
                     inc_pc = 1;
-                    inc_cycle = 4;
                 } else if ( ls_nibble == 5 ) {
                     // Reserved instruction
-                    log( "Executed reserved instruction A5!" );
+                    anomalies.record( Anomaly::reserved_instruction, pc, cycle_count );
+                    if ( log_enabled( LogLevel::warning ) )
+                        log( LogLevel::warning, "Executed reserved instruction A5!" );
                     inc_pc = 1;
-                    inc_cycle = 1;
                 } else {
                     *value = direct_acc( arg1 );
                     inc_pc = 2;
@@ -434,17 +840,20 @@ void Processor::do_cycle() {
             case 0xB: // CJNE operand,#data,offset
                 if ( ls_nibble == 4 ) {
                     pc += 3;
-                    if ( a != arg1 )
+                    branch_outcome = a != arg1;
+                    if ( branch_outcome )
                         pc += *reinterpret_cast<i8 *>( &arg2 );
                     set_bit_to( carry_addr, a < arg1 );
                 } else if ( ls_nibble == 5 ) {
                     pc += 3;
-                    if ( a != *value )
+                    branch_outcome = a != *value;
+                    if ( branch_outcome )
                         pc += *reinterpret_cast<i8 *>( &arg2 );
                     set_bit_to( carry_addr, a < *value );
                 } else {
                     pc += 3;
-                    if ( *value != arg1 )
+                    branch_outcome = *value != arg1;
+                    if ( branch_outcome )
                         pc += *reinterpret_cast<i8 *>( &arg2 );
                     set_bit_to( carry_addr, *value < arg1 );
                 }
@@ -462,7 +871,6 @@ void Processor::do_cycle() {
                     set_bit_to( parity_addr, parity_of_byte( a ) );
                     inc_pc = ls_nibble == 5 ? 2 : 1;
                 }
-                inc_cycle = 1;
                 break;
             case 0xD: // DJNZ operand,offset
                 if ( ls_nibble == 4 ) {
@@ -473,30 +881,30 @@ void Processor::do_cycle() {
                         a += 6;
                     }
                     if ( ( ( a & 0xf0 ) >> 4 ) > 9 || is_bit_set( carry_addr ) ) {
-                        if ( static_cast<u16>( a ) + 6 > 0xff )
+                        if ( static_cast<u16>( a ) + 0x60 > 0xff )
                             set_bit_to( carry_addr, true );
                         a += 0x60;
                     }
                     set_bit_to( parity_addr, parity_of_byte( a ) );
                     inc_pc = 1;
-                    inc_cycle = 1;
                 } else if ( ls_nibble == 6 || ls_nibble == 7 ) {
                     // Actually encodes XCHD
                     u8 tmp = *value & 0xf;
                     *value = ( *value & 0xf0 ) | ( a & 0xf );
                     a = ( a & 0xf0 ) | tmp;
                     inc_pc = 1;
-                    inc_cycle = 1;
                 } else if ( ls_nibble == 5 ) {
                     pc += 3; // Documentation specifies 2, but 3 makes more sense.
                     ( *value )--;
-                    if ( *value != 0 )
+                    branch_outcome = *value != 0;
+                    if ( branch_outcome )
                         pc += *reinterpret_cast<i8 *>( second_operand );
                     inc_pc = 0;
                 } else {
                     pc += 2;
                     ( *value )--;
-                    if ( *value != 0 )
+                    branch_outcome = *value != 0;
+                    if ( branch_outcome )
                         pc += *reinterpret_cast<i8 *>( &arg1 );
                     inc_pc = 0;
                 }
@@ -510,7 +918,6 @@ void Processor::do_cycle() {
                     a = *value;
                     set_bit_to( parity_addr, parity_of_byte( a ) );
                 }
-                inc_cycle = 1;
                 break;
             case 0xF: // MOV operand,A
                 if ( ls_nibble == 4 ) {
@@ -521,12 +928,19 @@ void Processor::do_cycle() {
                     *value = a;
                     set_bit_to( parity_addr, parity_of_byte( a ) );
                 }
-                inc_cycle = 1;
                 break;
 
             default:
                 break;
             }
+
+            if ( writes_value )
+                note_write<tracked>( value_space, value_addr );
+            if ( ms_nibble == 0x8 && ls_nibble != 4 ) {
+                // MOV direct,operand
+                u8 dest = ls_nibble == 5 ? arg2 : arg1;
+                note_write<tracked>( direct_space( dest ), dest );
+            }
         } else {
             // Irregular instruction
             if ( ( instr & 0b11111 ) == 1 ) {
@@ -539,62 +953,75 @@ void Processor::do_cycle() {
                 pc += 2;
                 sp++;
                 iram[sp] = pc & 0xff;
+                note_write<tracked>( MemSpace::iram, sp );
                 sp++;
-                iram[sp] = pc & 0xff00;
+                iram[sp] = pc >> 8;
+                note_write<tracked>( MemSpace::iram, sp );
+                shadow_stack.push_back( { pc, sp, false } );
                 pc = ( pc & 0b1111100000000000 ) + ( static_cast<u16>( instr & 0b11100000 ) << 3 ) + arg1;
                 inc_pc = 0;
             } else {
                 if ( ls_nibble == 0 ) {
                     switch ( ms_nibble ) {
                     case 0x0: // NOP
-                        inc_cycle = 1;
                         break;
                     case 0x1: // JBC bit,offset
                         pc += 3;
-                        if ( is_bit_set( arg1 ) ) {
+                        note_read<tracked>( direct_space( bit_byte_addr( arg1 ) ), bit_byte_addr( arg1 ) );
+                        branch_outcome = is_bit_set( arg1 );
+                        if ( branch_outcome ) {
                             set_bit_to( arg1, false );
+                            note_write<tracked>( direct_space( bit_byte_addr( arg1 ) ), bit_byte_addr( arg1 ) );
                             pc += *reinterpret_cast<i8 *>( &arg2 );
                         }
                         inc_pc = 0;
                         break;
                     case 0x2: // JB bit,offset
                         pc += 3;
-                        if ( is_bit_set( arg1 ) ) {
+                        note_read<tracked>( direct_space( bit_byte_addr( arg1 ) ), bit_byte_addr( arg1 ) );
+                        branch_outcome = is_bit_set( arg1 );
+                        if ( branch_outcome ) {
                             pc += *reinterpret_cast<i8 *>( &arg2 );
                         }
                         inc_pc = 0;
                         break;
                     case 0x3: // JNB bit,offset
                         pc += 3;
-                        if ( !is_bit_set( arg1 ) ) {
+                        note_read<tracked>( direct_space( bit_byte_addr( arg1 ) ), bit_byte_addr( arg1 ) );
+                        branch_outcome = !is_bit_set( arg1 );
+                        if ( branch_outcome ) {
                             pc += *reinterpret_cast<i8 *>( &arg2 );
                         }
                         inc_pc = 0;
                         break;
                     case 0x4: // JC offset
                         pc += 2;
-                        if ( is_bit_set( carry_addr ) ) {
+                        branch_outcome = is_bit_set( carry_addr );
+                        if ( branch_outcome ) {
                             pc += *reinterpret_cast<i8 *>( &arg1 );
                         }
                         inc_pc = 0;
                         break;
                     case 0x5: // JNC offset
                         pc += 2;
-                        if ( !is_bit_set( carry_addr ) ) {
+                        branch_outcome = !is_bit_set( carry_addr );
+                        if ( branch_outcome ) {
                             pc += *reinterpret_cast<i8 *>( &arg1 );
                         }
                         inc_pc = 0;
                         break;
                     case 0x6: // JZ offset
                         pc += 2;
-                        if ( a == 0 ) {
+                        branch_outcome = a == 0;
+                        if ( branch_outcome ) {
                             pc += *reinterpret_cast<i8 *>( &arg1 );
                         }
                         inc_pc = 0;
                         break;
                     case 0x7: // JNZ offset
                         pc += 2;
-                        if ( a != 0 ) {
+                        branch_outcome = a != 0;
+                        if ( branch_outcome ) {
                             pc += *reinterpret_cast<i8 *>( &arg1 );
                         }
                         inc_pc = 0;
@@ -609,30 +1036,40 @@ void Processor::do_cycle() {
                         inc_pc = 3;
                         break;
                     case 0xA: // ORL C,/bit
+                        note_read<tracked>( direct_space( bit_byte_addr( arg1 ) ), bit_byte_addr( arg1 ) );
                         set_bit_to( carry_addr, is_bit_set( carry_addr ) | !is_bit_set( arg1 ) );
                         inc_pc = 2;
                         break;
                     case 0xB: // ANL C,/bit
+                        note_read<tracked>( direct_space( bit_byte_addr( arg1 ) ), bit_byte_addr( arg1 ) );
                         set_bit_to( carry_addr, is_bit_set( carry_addr ) & !is_bit_set( arg1 ) );
                         inc_pc = 2;
                         break;
                     case 0xC: // PUSH address
+                        note_read<tracked>( direct_space( arg1 ), arg1 );
                         sp++;
                         iram[sp] = direct_acc( arg1 );
+                        note_write<tracked>( MemSpace::iram, sp );
                         inc_pc = 2;
                         break;
                     case 0xD: // POP address
+                        note_read<tracked>( MemSpace::iram, sp );
                         direct_acc( arg1 ) = iram[sp];
+                        note_write<tracked>( direct_space( arg1 ), arg1 );
                         sp--;
                         inc_pc = 2;
                         break;
                     case 0xE: // MOVX A,@DPTR
-                        a = xram[( static_cast<u16>( dph ) << 8 ) + dpl];
+                        note_read<tracked>( MemSpace::xram, ( static_cast<u16>( dph ) << 8 ) + dpl );
+                        stats.movx_reads++;
+                        a = std::as_const( xram )[( static_cast<u16>( dph ) << 8 ) + dpl];
                         set_bit_to( parity_addr, parity_of_byte( a ) );
                         break;
                     case 0xF: // MOVX @DPTR,A
                         xram[( static_cast<u16>( dph ) << 8 ) | dpl] =
                             a; // Missing in documentation, but this makes sense.
+                        note_write<tracked>( MemSpace::xram, ( static_cast<u16>( dph ) << 8 ) | dpl );
+                        stats.movx_writes++;
                         break;
 
                     default:
@@ -648,77 +1085,98 @@ void Processor::do_cycle() {
                         pc += 3;
                         sp++;
                         iram[sp] = pc & 0xff;
+                        note_write<tracked>( MemSpace::iram, sp );
                         sp++;
                         iram[sp] = ( pc & 0xff00 ) >> 8;
+                        note_write<tracked>( MemSpace::iram, sp );
+                        shadow_stack.push_back( { pc, sp, false } );
                         pc = ( static_cast<u16>( arg1 ) << 8 ) | arg2;
                         inc_pc = 0;
                         break;
                     case 0x2: // RET
+                        note_read<tracked>( MemSpace::iram, sp );
+                        note_read<tracked>( MemSpace::iram, static_cast<u8>( sp - 1 ) );
                         pc = ( static_cast<u16>( iram[sp] ) << 8 ) | iram[sp - 1];
+                        shadow_return( sp );
                         sp -= 2;
                         inc_pc = 0;
                         break;
                     case 0x3: // RETI
+                        note_read<tracked>( MemSpace::iram, sp );
+                        note_read<tracked>( MemSpace::iram, static_cast<u8>( sp - 1 ) );
                         pc = ( static_cast<u16>( iram[sp] ) << 8 ) | iram[sp - 1];
+                        shadow_return( sp );
                         sp -= 2;
                         inc_pc = 0;
+                        note_event<tracked>( Event::interrupt_exit, MemSpace::code, pc, 0 );
                         is_in_interrupt = false;
                         is_in_high_prio_intr = false;
                         was_in_interrupt = true;
                         break;
                     case 0x4: // ORL address,A
+                        note_read<tracked>( direct_space( arg1 ), arg1 );
                         direct_acc( arg1 ) |= a;
+                        note_write<tracked>( direct_space( arg1 ), arg1 );
                         inc_pc = 2;
-                        inc_cycle = 1;
                         break;
                     case 0x5: // ANL address,A
+                        note_read<tracked>( direct_space( arg1 ), arg1 );
                         direct_acc( arg1 ) &= a;
+                        note_write<tracked>( direct_space( arg1 ), arg1 );
                         inc_pc = 2;
-                        inc_cycle = 1;
                         break;
                     case 0x6: // XRL address,A
+                        note_read<tracked>( direct_space( arg1 ), arg1 );
                         direct_acc( arg1 ) ^= a;
+                        note_write<tracked>( direct_space( arg1 ), arg1 );
                         inc_pc = 2;
-                        inc_cycle = 1;
                         break;
                     case 0x7: // ORL C,bit
+                        note_read<tracked>( direct_space( bit_byte_addr( arg1 ) ), bit_byte_addr( arg1 ) );
                         set_bit_to( carry_addr, is_bit_set( carry_addr ) | is_bit_set( arg1 ) );
                         inc_pc = 2;
                         break;
                     case 0x8: // ANL C,bit
+                        note_read<tracked>( direct_space( bit_byte_addr( arg1 ) ), bit_byte_addr( arg1 ) );
                         set_bit_to( carry_addr, is_bit_set( carry_addr ) & is_bit_set( arg1 ) );
                         inc_pc = 2;
                         break;
                     case 0x9: // MOV bit,C
                         set_bit_to( arg1, is_bit_set( carry_addr ) );
+                        note_write<tracked>( direct_space( bit_byte_addr( arg1 ) ), bit_byte_addr( arg1 ) );
                         inc_pc = 2;
                         break;
                     case 0xA: // MOV C,bit
+                        note_read<tracked>( direct_space( bit_byte_addr( arg1 ) ), bit_byte_addr( arg1 ) );
                         set_bit_to( carry_addr, is_bit_set( arg1 ) );
                         inc_pc = 2;
-                        inc_cycle = 1;
                         break;
                     case 0xB: // CPL bit
+                        note_read<tracked>( direct_space( bit_byte_addr( arg1 ) ), bit_byte_addr( arg1 ) );
                         set_bit_to( arg1, !is_bit_set( arg1 ) );
+                        note_write<tracked>( direct_space( bit_byte_addr( arg1 ) ), bit_byte_addr( arg1 ) );
                         inc_pc = 2;
-                        inc_cycle = 1;
                         break;
                     case 0xC: // CLR bit
                         set_bit_to( arg1, false );
+                        note_write<tracked>( direct_space( bit_byte_addr( arg1 ) ), bit_byte_addr( arg1 ) );
                         inc_pc = 2;
-                        inc_cycle = 1;
                         break;
                     case 0xD: // SETB bit
                         set_bit_to( arg1, true );
+                        note_write<tracked>( direct_space( bit_byte_addr( arg1 ) ), bit_byte_addr( arg1 ) );
                         inc_pc = 2;
-                        inc_cycle = 1;
                         break;
                     case 0xE: // MOVX A,@R0
-                        a = xram[( static_cast<u16>( p2 ) << 8 ) + r0];
+                        note_read<tracked>( MemSpace::xram, ( static_cast<u16>( p2 ) << 8 ) + r0 );
+                        stats.movx_reads++;
+                        a = std::as_const( xram )[( static_cast<u16>( p2 ) << 8 ) + r0];
                         set_bit_to( parity_addr, parity_of_byte( a ) );
                         break;
                     case 0xF: // MOVX @R0,A
                         xram[( static_cast<u16>( p2 ) << 8 ) + r0] = a;
+                        note_write<tracked>( MemSpace::xram, ( static_cast<u16>( p2 ) << 8 ) + r0 );
+                        stats.movx_writes++;
                         break;
 
                     default:
@@ -731,40 +1189,42 @@ void Processor::do_cycle() {
                         a >>= 1;
                         if ( bit )
                             a |= 0b10000000;
-                        inc_cycle = 1;
                         break;
                     case 0x1: // RRC A
                         bit = is_bit_set( acc_0_addr );
                         a >>= 1;
-                        set_bit_to( acc_7_addr, carry_addr );
+                        set_bit_to( acc_7_addr, is_bit_set( carry_addr ) );
                         set_bit_to( carry_addr, bit );
                         set_bit_to( parity_addr, parity_of_byte( a ) );
-                        inc_cycle = 1;
                         break;
                     case 0x2: // RL A
                         bit = is_bit_set( acc_7_addr );
                         a <<= 1;
                         set_bit_to( acc_0_addr, bit );
-                        inc_cycle = 1;
                         break;
                     case 0x3: // RLC A
                         bit = is_bit_set( acc_7_addr );
                         a <<= 1;
-                        set_bit_to( acc_0_addr, carry_addr );
+                        set_bit_to( acc_0_addr, is_bit_set( carry_addr ) );
                         set_bit_to( carry_addr, bit );
                         set_bit_to( parity_addr, parity_of_byte( a ) );
-                        inc_cycle = 1;
                         break;
                     case 0x4: // ORL address,#data
+                        note_read<tracked>( direct_space( arg1 ), arg1 );
                         direct_acc( arg1 ) |= arg2;
+                        note_write<tracked>( direct_space( arg1 ), arg1 );
                         inc_pc = 3;
                         break;
                     case 0x5: // ANL address,#data
+                        note_read<tracked>( direct_space( arg1 ), arg1 );
                         direct_acc( arg1 ) &= arg2;
+                        note_write<tracked>( direct_space( arg1 ), arg1 );
                         inc_pc = 3;
                         break;
                     case 0x6: // XRL address,#data
+                        note_read<tracked>( direct_space( arg1 ), arg1 );
                         direct_acc( arg1 ) ^= arg2;
+                        note_write<tracked>( direct_space( arg1 ), arg1 );
                         inc_pc = 3;
                         break;
                     case 0x7: // JMP @A+DPTR
@@ -773,12 +1233,15 @@ void Processor::do_cycle() {
                         break;
                     case 0x8: // MOVC A,@A+PC
                         pc++;
-                        a = text[pc + static_cast<u16>( a )];
+                        note_read<tracked>( MemSpace::code, pc + static_cast<u16>( a ) );
+                        a = code[pc + static_cast<u16>( a )];
                         set_bit_to( parity_addr, parity_of_byte( a ) );
                         inc_pc = 0;
                         break;
                     case 0x9: // MOVC A,@A+DPTR
-                        a = text[( ( static_cast<u16>( dph ) << 8 ) | dpl ) + static_cast<u16>( a )];
+                        note_read<tracked>( MemSpace::code,
+                                            ( ( static_cast<u16>( dph ) << 8 ) | dpl ) + static_cast<u16>( a ) );
+                        a = code[( ( static_cast<u16>( dph ) << 8 ) | dpl ) + static_cast<u16>( a )];
                         set_bit_to( parity_addr, parity_of_byte( a ) );
                         break;
                     case 0xA: // INC DPTR
@@ -788,22 +1251,23 @@ void Processor::do_cycle() {
                         break;
                     case 0xB: // CPL C
                         set_bit_to( carry_addr, !is_bit_set( carry_addr ) );
-                        inc_cycle = 1;
                         break;
                     case 0xC: // CLR C
                         set_bit_to( carry_addr, false );
-                        inc_cycle = 1;
                         break;
                     case 0xD: // SETB C
                         set_bit_to( carry_addr, true );
-                        inc_cycle = 1;
                         break;
                     case 0xE: // MOVX A,@R1
-                        a = xram[( static_cast<u16>( p2 ) << 8 ) + r1];
+                        note_read<tracked>( MemSpace::xram, ( static_cast<u16>( p2 ) << 8 ) + r1 );
+                        stats.movx_reads++;
+                        a = std::as_const( xram )[( static_cast<u16>( p2 ) << 8 ) + r1];
                         set_bit_to( parity_addr, parity_of_byte( a ) );
                         break;
                     case 0xF: // MOVX @R1,A
                         xram[( static_cast<u16>( p2 ) << 8 ) + r1] = a;
+                        note_write<tracked>( MemSpace::xram, ( static_cast<u16>( p2 ) << 8 ) + r1 );
+                        stats.movx_writes++;
                         break;
 
                     default:
@@ -812,16 +1276,37 @@ void Processor::do_cycle() {
                 }
             }
         }
+
+        if ( record_coverage ) {
+            coverage.executed.set( instr_addr );
+            if ( branch_outcome == 1 )
+                coverage.branch_taken.set( instr_addr );
+            else if ( branch_outcome == 0 )
+                coverage.branch_not_taken.set( instr_addr );
+        }
     }
 
     if ( pcon & 1 ) {
         // Is in idle
         inc_pc = 0;
         inc_cycle = 1;
+        stats.idle_cycles++;
     }
     pc += inc_pc;
     cycle_count += inc_cycle;
 
+    zone.next( Zone::timers );
+    // Sets the overflow flag of a timer (if any) and reports the overflow.
+    u8 timer1_overflows = 0; // Baud rate clock of the serial port.
+    auto timer_overflow = [&]( u8 timer, u8 flag_addr ) {
+        if ( timer == 1 )
+            timer1_overflows++;
+        stats.timer_overflows[timer]++;
+        if ( flag_addr != 0 )
+            set_bit_to( flag_addr, true );
+        note_event<tracked>( Event::timer_overflow, MemSpace::sfr, timer, flag_addr );
+    };
+
     // Timer 0 handling
     u8 tmod_val = tmod;
     u8 mode0 = tmod_val & 0b11;
@@ -848,7 +1333,7 @@ void Processor::do_cycle() {
                 tl &= 0x1f;
                 th++;
                 if ( th == 0 ) // counter overflow
-                    set_bit_to( tcon_tf0, true );
+                    timer_overflow( 0, tcon_tf0 );
             } else {
                 tl += count;
             }
@@ -858,14 +1343,14 @@ void Processor::do_cycle() {
                 // Overflow to th
                 th++;
                 if ( th == 0 ) // counter overflow
-                    set_bit_to( tcon_tf0, true );
+                    timer_overflow( 0, tcon_tf0 );
             }
             tl += count;
         } else if ( mode0 == 2 ) {
             // 8 bit counter with auto reload.
             if ( tl >= (u8) ( 0 - count ) ) {
                 // Overflow
-                set_bit_to( tcon_tf0, true );
+                timer_overflow( 0, tcon_tf0 );
                 tl += th; // Keep the uncounted increment.
             }
             tl += count;
@@ -873,7 +1358,7 @@ void Processor::do_cycle() {
             // 8 bit counting on TL0. TH0 is handled below
             if ( tl >= (u8) ( 0 - count ) ) {
                 // Overflow in TL0
-                set_bit_to( tcon_tf0, true );
+                timer_overflow( 0, tcon_tf0 );
             }
             tl += count;
         }
@@ -900,8 +1385,8 @@ void Processor::do_cycle() {
                 tl += count;
                 tl &= 0x1f;
                 th++;
-                if ( th == 0 && mode0 != 3 ) // counter overflow
-                    set_bit_to( tcon_tf1, true );
+                if ( th == 0 ) // counter overflow
+                    timer_overflow( 1, mode0 != 3 ? tcon_tf1 : 0 );
             } else {
                 tl += count;
             }
@@ -910,16 +1395,15 @@ void Processor::do_cycle() {
             if ( tl >= (u8) ( 0 - count ) ) {
                 // Overflow to th
                 th++;
-                if ( th == 0 && mode0 != 3 ) // counter overflow
-                    set_bit_to( tcon_tf1, true );
+                if ( th == 0 ) // counter overflow
+                    timer_overflow( 1, mode0 != 3 ? tcon_tf1 : 0 );
             }
             tl += count;
         } else if ( mode1 == 2 ) {
             // 8 bit counter with auto reload.
             if ( tl >= (u8) ( 0 - count ) ) {
                 // Overflow
-                if ( mode0 != 3 )
-                    set_bit_to( tcon_tf1, true );
+                timer_overflow( 1, mode0 != 3 ? tcon_tf1 : 0 );
                 tl += th; // Keep the uncounted increment.
             }
             tl += count;
@@ -931,17 +1415,34 @@ void Processor::do_cycle() {
             // TH0 uses inc_cycle directly! (never counts port flanks)
             if ( th0 >= (u8) ( 0 - inc_cycle ) ) {
                 // Overflow in TH0
-                set_bit_to( tcon_tf1, true ); // Interrupt on TC1!
+                timer_overflow( 0, tcon_tf1 ); // Interrupt on TC1!
             }
             th0 += inc_cycle;
         }
     }
     timer_1_in_mem = is_bit_set( p3_t1 );
 
+    // Serial port handling
+    zone.next( Zone::serial );
+    if ( serial.transmit_ticks != 0 || serial.receive_ticks != 0 || ( ( scon & 0x10 ) && !serial.input.empty() ) )
+        serial_cycle( inc_cycle, timer1_overflows );
+
     // Check breakpoints (if not in idle)
-    if ( !( pcon & 1 ) && ( text[pc] == break_instruction || std::find( break_addresses.begin(), break_addresses.end(),
-                                                                        pc ) != break_addresses.end() ) ) {
+    zone.next( Zone::breakpoints );
+    if ( ( tracked && watch_hit ) ||
+         ( !( pcon & 1 ) && ( std::as_const( text )[pc] == break_instruction ||
+                              ( ( breakpoints.armed & Breakpoints::execute ) && breakpoints.code_execute.test( pc ) &&
+                                break_here( pc ) ) ) ) ) {
         // Hit breakpoint
+        step_mode = StepMode::none; // Breakpoints also end steps.
+        instrumentation.flush();
+        break_callback( *this );
+        watch_hit.reset();
+    } else if ( step_mode != StepMode::none && step_finished() ) {
+        step_mode = StepMode::none;
+        step_completed = true;
+        instrumentation.flush();
         break_callback( *this );
+        step_completed = false;
     }
 }
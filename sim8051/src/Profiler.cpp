@@ -0,0 +1,142 @@
+#include "sim8051/stdafx.hpp"
+#include "sim8051/Profiler.hpp"
+
+Profiler profiler;
+
+std::atomic<u32> next_thread_id{ 1 };
+thread_local u32 thread_id = next_thread_id.fetch_add( 1, std::memory_order_relaxed ); // Of the trace events.
+
+const char *zone_name( Zone zone ) {
+    static constexpr const char *names[] = {
+        "interrupts", "dispatch", "timers", "serial", "breakpoints",
+        "frame", "frame_sync", "frame_events", "frame_windows", "frame_render",
+    };
+    static_assert( std::size( names ) == static_cast<size_t>( Zone::count ) );
+    return zone < Zone::count ? names[static_cast<size_t>( zone )] : "unknown";
+}
+
+Profiler::Profiler() : start_ticks( now() ), start_time( std::chrono::steady_clock::now() ) {}
+
+f64 Profiler::ticks_per_second() const {
+#ifdef SIM8051_HAS_TSC
+    // The measurement needs some time to be accurate.
+    auto minimum = start_time + std::chrono::milliseconds( 50 );
+    if ( std::chrono::steady_clock::now() < minimum )
+        std::this_thread::sleep_until( minimum );
+    u64 ticks = now() - start_ticks;
+    return ticks / std::chrono::duration<f64>( std::chrono::steady_clock::now() - start_time ).count();
+#else
+    return std::chrono::steady_clock::period::den / static_cast<f64>( std::chrono::steady_clock::period::num );
+#endif
+}
+
+Profiler::ThreadCounters &Profiler::thread_counters() {
+    // The counters outlive their thread, so the calls of finished threads are kept.
+    thread_local ThreadCounters *counters = [this] {
+        std::lock_guard<std::mutex> lock( threads_mutex );
+        threads.push_back( std::make_unique<ThreadCounters>() );
+        return threads.back().get();
+    }();
+    return *counters;
+}
+
+void Profiler::add( Zone zone, u64 start, u64 end ) {
+    u64 ticks = end - start;
+    auto &local = thread_counters();
+    u64 current_epoch = epoch.load( std::memory_order_relaxed );
+    if ( local.epoch.load( std::memory_order_relaxed ) != current_epoch ) {
+        // The first call since a reset clears the counters of the thread.
+        for ( auto &c : local.counters ) {
+            c.calls.store( 0, std::memory_order_relaxed );
+            c.ticks.store( 0, std::memory_order_relaxed );
+            c.max_ticks.store( 0, std::memory_order_relaxed );
+        }
+        local.epoch.store( current_epoch, std::memory_order_release );
+    }
+    // Plain loads and stores, the thread is the only writer.
+    auto &c = local.counters[static_cast<size_t>( zone )];
+    c.calls.store( c.calls.load( std::memory_order_relaxed ) + 1, std::memory_order_relaxed );
+    c.ticks.store( c.ticks.load( std::memory_order_relaxed ) + ticks, std::memory_order_relaxed );
+    if ( ticks > c.max_ticks.load( std::memory_order_relaxed ) )
+        c.max_ticks.store( ticks, std::memory_order_relaxed );
+
+    if ( tracing.load( std::memory_order_relaxed ) ) {
+        u64 index = trace_claimed.fetch_add( 1, std::memory_order_relaxed );
+        if ( index < trace_capacity ) {
+            auto &event = trace[index];
+            event.start = start;
+            event.end = end;
+            event.thread = thread_id;
+            event.zone.store( static_cast<u8>( zone ) + 1, std::memory_order_release );
+        }
+    }
+}
+
+ZoneTotals Profiler::totals( Zone zone ) const {
+    ZoneTotals sum;
+    u64 current_epoch = epoch.load( std::memory_order_relaxed );
+    std::lock_guard<std::mutex> lock( threads_mutex );
+    for ( auto &local : threads ) {
+        if ( local->epoch.load( std::memory_order_acquire ) != current_epoch )
+            continue; // Not cleared since the last reset.
+        auto &c = local->counters[static_cast<size_t>( zone )];
+        sum.calls += c.calls.load( std::memory_order_relaxed );
+        sum.ticks += c.ticks.load( std::memory_order_relaxed );
+        sum.max_ticks = std::max( sum.max_ticks, c.max_ticks.load( std::memory_order_relaxed ) );
+    }
+    return sum;
+}
+
+void Profiler::reset() {
+    // Every thread clears its own counters, otherwise a concurrent increment could undo the reset.
+    epoch.fetch_add( 1, std::memory_order_relaxed );
+}
+
+void Profiler::start_trace() {
+    if ( tracing.load( std::memory_order_relaxed ) )
+        return;
+    if ( !trace )
+        trace.reset( new TraceEvent[trace_capacity] );
+    // Writers which claimed an event of the previous trace finished (see write_trace()).
+    for ( size_t i = 0; i < trace_written; i++ )
+        trace[i].zone.store( 0, std::memory_order_relaxed );
+    trace_written = 0;
+    trace_claimed.store( 0, std::memory_order_relaxed );
+    tracing.store( true, std::memory_order_release );
+    set_active( true );
+}
+
+bool Profiler::write_trace( std::ostream &output ) {
+    if ( !trace )
+        return false;
+    // Later writers get an index beyond the capacity, so no event is written while they are read.
+    if ( tracing.exchange( false, std::memory_order_relaxed ) )
+        trace_written = std::min<u64>( trace_claimed.exchange( trace_capacity, std::memory_order_relaxed ),
+                                       trace_capacity );
+    size_t size = trace_written;
+    if ( size == 0 )
+        return false;
+
+    u64 base = std::numeric_limits<u64>::max();
+    for ( size_t i = 0; i < size; i++ ) {
+        while ( trace[i].zone.load( std::memory_order_acquire ) == 0 )
+            std::this_thread::yield(); // Claimed, but not written yet.
+        base = std::min( base, trace[i].start );
+    }
+
+    f64 us_per_tick = 1e6 / ticks_per_second();
+    output << "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n";
+    output << std::fixed << std::setprecision( 3 );
+    for ( size_t i = 0; i < size; i++ ) {
+        auto &event = trace[i];
+        Zone zone = static_cast<Zone>( event.zone.load( std::memory_order_relaxed ) - 1 );
+        // Complete events ("X") with start and duration in microseconds.
+        output << "{\"name\":\"" << zone_name( zone ) << "\",\"ph\":\"X\",\"pid\":1,\"tid\":" << event.thread
+               << ",\"ts\":" << ( event.start - base ) * us_per_tick
+               << ",\"dur\":" << ( event.end - event.start ) * us_per_tick << "}" << ( i + 1 < size ? "," : "" )
+               << '\n';
+    }
+    output << "]}\n";
+    output << std::defaultfloat;
+    return true;
+}
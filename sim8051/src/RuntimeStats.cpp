@@ -0,0 +1,63 @@
+#include "sim8051/stdafx.hpp"
+#include "sim8051/RuntimeStats.hpp"
+#include "sim8051/InstructionSet.hpp"
+#include "sim8051/Encoding.hpp"
+
+u64 RuntimeStats::instructions() const {
+    u64 sum = 0;
+    for ( auto count : opcodes )
+        sum += count;
+    return sum;
+}
+
+void RuntimeStats::clear( u64 cycle_count ) {
+    *this = RuntimeStats();
+    start_cycle = cycle_count;
+}
+
+void RuntimeStats::write_json( std::ostream &output, u64 cycle_count, size_t indent ) const {
+    String space( indent, ' ' );
+    u64 cycles = cycle_count - start_cycle;
+    u64 executed = instructions();
+    output << "{\n";
+    output << space << "  \"instructions\": " << executed << ",\n";
+    output << space << "  \"simulated_cycles\": " << cycles << ",\n";
+    output << space << "  \"host_seconds\": " << host_seconds << ",\n";
+    output << space << "  \"cycles_per_host_second\": " << ( host_seconds > 0 ? cycles / host_seconds : 0 ) << ",\n";
+    output << space << "  \"idle_cycles\": " << idle_cycles << ",\n";
+    output << space << "  \"power_down_steps\": " << power_down_steps << ",\n";
+    output << space << "  \"movx_reads\": " << movx_reads << ",\n";
+    output << space << "  \"movx_writes\": " << movx_writes << ",\n";
+    output << space << "  \"timer_overflows\": [ " << timer_overflows[0] << ", " << timer_overflows[1] << " ],\n";
+
+    output << space << "  \"interrupts\": { ";
+    for ( size_t i = 0; i < interrupts.size(); i++ )
+        output << ( i > 0 ? ", " : "" ) << '"' << interrupt_names[i] << "\": " << interrupts[i];
+    output << " },\n";
+
+    std::array<u64, std::size( mnemonic_names )> mnemonics = {};
+    for ( size_t op = 0; op < opcodes.size(); op++ )
+        mnemonics[static_cast<u8>( instruction_set[op].mnemonic )] += opcodes[op];
+    output << space << "  \"mnemonics\": {";
+    bool first = true;
+    for ( size_t i = 0; i < mnemonics.size(); i++ ) {
+        if ( mnemonics[i] == 0 )
+            continue;
+        output << ( first ? " " : ", " ) << '"' << mnemonic_names[i] << "\": " << mnemonics[i];
+        first = false;
+    }
+    output << " },\n";
+
+    // Eight op codes per line, so the files can be diffed easily.
+    output << space << "  \"opcodes\": {";
+    size_t written = 0;
+    for ( size_t op = 0; op < opcodes.size(); op++ ) {
+        if ( opcodes[op] == 0 )
+            continue;
+        output << ( written == 0 ? "" : "," ) << ( written % 8 == 0 ? "\n" + space + "    " : " " ) << "\""
+               << to_hex_str( op ) << "\": " << opcodes[op];
+        written++;
+    }
+    output << ( written > 0 ? "\n" + space + "  }\n" : " }\n" );
+    output << space << "}";
+}
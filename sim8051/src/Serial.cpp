@@ -0,0 +1,146 @@
+#include "sim8051/stdafx.hpp"
+#include "sim8051/Serial.hpp"
+#include "sim8051/Processor.hpp"
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <termios.h>
+#include <unistd.h>
+#endif
+
+u32 SerialPort::frame_ticks( u8 scon, u8 pcon ) {
+    bool smod = pcon & 0x80; // Doubles the baud rate in modes 1, 2 and 3.
+    switch ( scon >> 6 ) {
+    case 0:
+        return 8 * 12; // 8 data bits, one bit per machine cycle.
+    case 1:
+        return 10 * ( smod ? 16 : 32 ); // Start bit, 8 data bits and stop bit.
+    case 2:
+        return 11 * ( smod ? 32 : 64 ); // Start bit, 9 data bits and stop bit.
+    default:
+        return 11 * ( smod ? 16 : 32 );
+    }
+}
+
+void SerialPort::reset() {
+    receive_buffer = 0;
+    transmit_frame = 0;
+    transmit_ticks = 0;
+    receive_frame = 0;
+    receive_ticks = 0;
+}
+
+void SerialPort::restore( const SerialPort &snapshot ) {
+    receive_buffer = snapshot.receive_buffer;
+    transmit_frame = snapshot.transmit_frame;
+    transmit_ticks = snapshot.transmit_ticks;
+    receive_frame = snapshot.receive_frame;
+    receive_ticks = snapshot.receive_ticks;
+}
+
+#ifndef _WIN32
+
+SerialBridge::~SerialBridge() {
+    if ( output_fd >= 0 && !output_buffer.empty() ) {
+        // Write the remaining output (blocking).
+        fcntl( output_fd, F_SETFL, fcntl( output_fd, F_GETFL ) & ~O_NONBLOCK );
+        size_t written = 0;
+        while ( written < output_buffer.size() ) {
+            auto ret = write( output_fd, output_buffer.data() + written, output_buffer.size() - written );
+            if ( ret <= 0 )
+                break;
+            written += ret;
+        }
+    }
+    if ( close_input )
+        close( input_fd );
+    if ( close_output && output_fd != input_fd )
+        close( output_fd );
+}
+
+String SerialBridge::open_pty() {
+    int fd = posix_openpt( O_RDWR | O_NOCTTY );
+    if ( fd < 0 || grantpt( fd ) != 0 || unlockpt( fd ) != 0 ) {
+        log( LogLevel::error, "Failed to create a pseudo-terminal." );
+        if ( fd >= 0 )
+            close( fd );
+        return "";
+    }
+
+    // Raw bytes without echo or line editing.
+    termios attributes;
+    if ( tcgetattr( fd, &attributes ) == 0 ) {
+        cfmakeraw( &attributes );
+        tcsetattr( fd, TCSANOW, &attributes );
+    }
+    fcntl( fd, F_SETFL, fcntl( fd, F_GETFL ) | O_NONBLOCK );
+
+    input_fd = output_fd = fd;
+    close_input = close_output = true;
+    return ptsname( fd );
+}
+
+bool SerialBridge::open_files( const String &input, const String &output ) {
+    if ( input == "-" ) {
+        input_fd = STDIN_FILENO;
+    } else if ( !input.empty() ) {
+        // Non-blocking, so that opening a pipe doesn't wait for the writer.
+        input_fd = open( input.c_str(), O_RDONLY | O_NONBLOCK );
+        close_input = true;
+    }
+    if ( output == "-" ) {
+        output_fd = STDOUT_FILENO;
+    } else if ( !output.empty() ) {
+        output_fd = open( output.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644 );
+        close_output = true;
+    }
+    if ( ( !input.empty() && input_fd < 0 ) || ( !output.empty() && output_fd < 0 ) ) {
+        log( LogLevel::error, "Failed to open the serial port files." );
+        return false;
+    }
+    if ( input_fd >= 0 )
+        fcntl( input_fd, F_SETFL, fcntl( input_fd, F_GETFL ) | O_NONBLOCK );
+    return true;
+}
+
+void SerialBridge::poll( Processor &processor ) {
+    auto &input = processor.serial.input;
+    if ( input_fd >= 0 && !input_finished && input.size() < max_queued_input ) {
+        std::array<u8, 1024> buffer;
+        auto ret = read( input_fd, buffer.data(), std::min( buffer.size(), max_queued_input - input.size() ) );
+        if ( ret > 0 ) {
+            for ( ssize_t i = 0; i < ret; i++ )
+                input.push_back( buffer[i] | 0x100 ); // The 9th bit is like a stop bit.
+        } else if ( ret == 0 && input_fd != output_fd ) {
+            input_finished = true; // A pseudo-terminal reports EIO instead while no host tool is connected.
+        }
+    }
+
+    if ( output_fd >= 0 && !output_buffer.empty() ) {
+        auto ret = write( output_fd, output_buffer.data(), output_buffer.size() );
+        if ( ret > 0 )
+            output_buffer.erase( 0, ret );
+    }
+}
+
+#else
+
+SerialBridge::~SerialBridge() {}
+
+String SerialBridge::open_pty() {
+    log( LogLevel::error, "Pseudo-terminals are not supported on this system." );
+    return "";
+}
+
+bool SerialBridge::open_files( const String &, const String & ) {
+    log( LogLevel::error, "The serial port bridge is not supported on this system." );
+    return false;
+}
+
+void SerialBridge::poll( Processor & ) {}
+
+#endif
+
+void SerialBridge::attach( Processor &processor ) {
+    processor.serial.transmit = [this]( u8 byte, bool ) { output_buffer.push_back( static_cast<char>( byte ) ); };
+}
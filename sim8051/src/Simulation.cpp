@@ -0,0 +1,144 @@
+#include "sim8051/stdafx.hpp"
+#include "sim8051/Simulation.hpp"
+#include "sim8051/Encoding.hpp"
+
+Simulation::Simulation() {
+    processor.break_callback = [this]( Processor &processor ) {
+        mode = Mode::paused;
+        if ( processor.watch_hit ) {
+            log( "Hit watchpoint (" + String( processor.watch_hit->write ? "write" : "read" ) + " " +
+                 mem_space_name( processor.watch_hit->space ) + " " + to_hex_str( processor.watch_hit->addr, 16 ) +
+                 ") before instruction '" + to_hex_str( processor.pc ) + "'" );
+        } else if ( !processor.step_completed ) {
+            log( "Hit breakpoint at instruction '" + to_hex_str( processor.pc ) + "'" );
+        }
+    };
+    thread = std::thread( [this] { run(); } );
+}
+
+Simulation::~Simulation() {
+    stop = true;
+    thread.join();
+}
+
+void Simulation::execute( Command command ) {
+    send( [this, command = std::move( command )]() { command( processor ); } );
+}
+
+void Simulation::set_mode( Mode new_mode ) {
+    send( [this, new_mode]() {
+        mode = new_mode;
+        if ( mode == Mode::real_time )
+            pacer.start( processor.cycle_count );
+    } );
+}
+
+void Simulation::set_pacing( f64 ratio, f64 oscillator_hz ) {
+    send( [this, ratio, oscillator_hz]() {
+        pacer.ratio = ratio;
+        pacer.oscillator_hz = oscillator_hz;
+        if ( mode == Mode::real_time )
+            pacer.start( processor.cycle_count );
+    } );
+}
+
+void Simulation::load( const String &file ) {
+    send( [this, file]() {
+        mode = Mode::paused;
+        processor.cancel_step();
+        if ( processor.load_hex_code( file ) ) {
+            program_version++;
+            log( "Loaded hex file" );
+        }
+        symbols_version++;
+    } );
+}
+
+void Simulation::load( std::vector<u8> code, std::map<u16, String> symbols ) {
+    send( [this, code = std::move( code ), symbols = std::move( symbols )]() mutable {
+        mode = Mode::paused;
+        processor.cancel_step();
+        if ( processor.load_code( code ) ) {
+            processor.symbols = std::move( symbols );
+            program_version++;
+            log( "Loaded program" );
+        }
+        symbols_version++;
+    } );
+}
+
+void Simulation::patch( size_t addr, std::vector<u8> bytes, std::map<u16, String> symbols ) {
+    send( [this, addr, bytes = std::move( bytes ), symbols = std::move( symbols )]() mutable {
+        for ( size_t i = 0; i < bytes.size() && addr + i < processor.text.size(); i++ )
+            processor.text[addr + i] = bytes[i];
+        processor.symbols = std::move( symbols );
+        symbols_version++;
+    } );
+}
+
+const Simulation::Snapshot &Simulation::snapshot() {
+    if ( middle_snapshot.load( std::memory_order_acquire ) & fresh_snapshot )
+        front_snapshot = middle_snapshot.exchange( front_snapshot, std::memory_order_acq_rel ) & ~fresh_snapshot;
+    snapshot_requested.store( true, std::memory_order_relaxed );
+    return snapshots[front_snapshot];
+}
+
+void Simulation::send( std::function<void()> &&function ) {
+    while ( !commands.push( std::move( function ) ) )
+        std::this_thread::yield();
+}
+
+void Simulation::publish() {
+    auto &snapshot = snapshots[back_snapshot];
+    snapshot.processor.restore( processor );
+    snapshot.processor.breakpoints = processor.breakpoints;
+    snapshot.processor.break_instruction = processor.break_instruction;
+    snapshot.processor.coverage = processor.coverage;
+    snapshot.processor.record_coverage = processor.record_coverage;
+    snapshot.mode = mode;
+    snapshot.stepping = processor.is_stepping();
+    snapshot.program_version = program_version;
+    if ( snapshot.symbols_version != symbols_version ) {
+        snapshot.processor.symbols = processor.symbols;
+        snapshot.symbols_version = symbols_version;
+    }
+    snapshot.real_time_ratio = mode == Mode::real_time ? pacer.achieved_ratio( processor.cycle_count ) : 0;
+    snapshot.worst_lag = pacer.worst_lag;
+    back_snapshot = middle_snapshot.exchange( back_snapshot | fresh_snapshot, std::memory_order_acq_rel ) &
+                    ~fresh_snapshot;
+}
+
+void Simulation::run() {
+    using Clock = std::chrono::steady_clock;
+    auto animation_period =
+        std::chrono::duration_cast<Clock::duration>( std::chrono::duration<f64>( 1 / animation_rate ) );
+    auto next_animation_step = Clock::now();
+    auto running = [&] { return mode == Mode::max_speed || mode == Mode::real_time || processor.is_stepping(); };
+
+    std::function<void()> command;
+    while ( !stop ) {
+        while ( commands.pop( command ) )
+            command();
+
+        if ( running() ) {
+            auto slice_start = Clock::now();
+            for ( size_t i = 0; i < slice_size && running(); i++ ) {
+                processor.do_cycle();
+                if ( mode == Mode::real_time )
+                    pacer.pace( processor.cycle_count );
+            }
+            processor.stats.host_seconds += std::chrono::duration<f64>( Clock::now() - slice_start ).count();
+        } else if ( mode == Mode::animated && Clock::now() >= next_animation_step ) {
+            auto step_start = Clock::now();
+            processor.do_cycle();
+            auto step_end = Clock::now();
+            processor.stats.host_seconds += std::chrono::duration<f64>( step_end - step_start ).count();
+            next_animation_step = step_end + animation_period;
+        } else {
+            std::this_thread::sleep_for( std::chrono::milliseconds( 1 ) ); // Idle
+        }
+
+        if ( snapshot_requested.exchange( false, std::memory_order_relaxed ) )
+            publish();
+    }
+}
@@ -0,0 +1,270 @@
+#include "sim8051/stdafx.hpp"
+#include "sim8051/TestCase.hpp"
+#include "sim8051/Assembler.hpp"
+#include "sim8051/Encoding.hpp"
+
+/// Parses a hexadecimal number with at most "digits" digits. Returns false on invalid numbers.
+bool parse_hex( const String &str, size_t digits, u16 &value ) {
+    if ( str.empty() || str.size() > digits || str.find_first_not_of( "0123456789abcdefABCDEF" ) != str.npos )
+        return false;
+    value = stoi( str, 0, 16 );
+    return true;
+}
+
+/// Parses a memory location followed by bytes ("iram 30 01 02", "psw 18", ...) from "words", starting at "first".
+/// Returns an error message (empty on success).
+String parse_memory_range( const std::vector<String> &words, size_t first, MemoryRange &range ) {
+    String key = to_lower( words[first] );
+    range.label = words[first];
+    size_t first_byte = first + 1;
+    u16 value;
+    u8 sfr_addr;
+    bool is_bit;
+    if ( ( key == "iram" || key == "xram" ) && words.size() >= first + 3 ) {
+        range.space = key == "iram" ? MemSpace::iram : MemSpace::xram;
+        if ( !parse_hex( words[first + 1], key == "iram" ? 2 : 4, value ) )
+            return "Invalid address '" + words[first + 1] + "'";
+        range.addr = value;
+        range.label += " " + words[first + 1];
+        first_byte = first + 2;
+    } else if ( key.size() == 2 && key[0] == 'r' && key[1] >= '0' && key[1] <= '7' && words.size() == first + 2 ) {
+        range.space = MemSpace::iram;
+        range.addr = key[1] - '0';
+        range.is_register = true;
+    } else if ( lookup_sfr_name( key, sfr_addr, is_bit ) && !is_bit && words.size() == first + 2 ) {
+        range.space = sfr_addr < 0x80 ? MemSpace::iram : MemSpace::sfr;
+        range.addr = sfr_addr;
+    } else {
+        return "Invalid location '" + words[first] + "'";
+    }
+    for ( size_t i = first_byte; i < words.size(); i++ ) {
+        if ( !parse_hex( words[i], 2, value ) )
+            return "Invalid byte '" + words[i] + "'";
+        range.bytes.push_back( value );
+    }
+    if ( range.addr + range.bytes.size() > ( key == "xram" ? 0x10000u : 0x100u ) )
+        return "Range exceeds the address space";
+    return "";
+}
+
+/// Parses hexadecimal bytes from "words", starting at "first". Returns false on invalid bytes.
+bool parse_bytes( const std::vector<String> &words, size_t first, std::vector<u8> &bytes ) {
+    u16 value;
+    for ( size_t i = first; i < words.size(); i++ ) {
+        if ( !parse_hex( words[i], 2, value ) )
+            return false;
+        bytes.push_back( value );
+    }
+    return true;
+}
+
+/// Returns whether "str" is a decimal number.
+bool is_decimal( const String &str ) {
+    return !str.empty() && str.size() < 20 && str.find_first_not_of( "0123456789" ) == str.npos;
+}
+
+bool load_test_case( const String &file, TestCase &test ) {
+    std::ifstream stream( file );
+    if ( !stream.good() ) {
+        log( LogLevel::error, "Failed to open test case '" + file + "'" );
+        return false;
+    }
+
+    std::filesystem::path path( file );
+    test = TestCase();
+    test.name = path.stem().string();
+    test.program = path.parent_path().append( test.name + ".hex" ).string();
+
+    String line;
+    size_t line_no = 0;
+    while ( std::getline( stream, line ) ) {
+        line_no++;
+        line = line.substr( 0, line.find( ';' ) );
+        std::stringstream line_stream( line );
+        std::vector<String> words;
+        String word;
+        while ( line_stream >> word )
+            words.push_back( word );
+        if ( words.empty() )
+            continue;
+
+        auto error = [&]( const String &msg ) {
+            log( LogLevel::error, file + ":" + to_string( line_no ) + ": " + msg );
+            return false;
+        };
+        String key = to_lower( words[0] );
+        u16 value;
+        if ( key == "program" && words.size() == 2 ) {
+            test.program = path.parent_path().append( words[1] ).string();
+        } else if ( key == "max_cycles" && words.size() == 2 && is_decimal( words[1] ) ) {
+            test.max_cycles = std::stoull( words[1] );
+        } else if ( key == "cycles" && words.size() == 2 && is_decimal( words[1] ) ) {
+            test.cycles = std::stoull( words[1] );
+        } else if ( key == "pc" && words.size() == 2 ) {
+            if ( !parse_hex( words[1], 4, value ) )
+                return error( "Invalid address '" + words[1] + "'" );
+            test.pc = value;
+        } else if ( key == "at" ) {
+            if ( words.size() < 4 || !is_decimal( words[1] ) )
+                return error( "Invalid line '" + line + "'" );
+            Stimulus stimulus;
+            stimulus.cycle = std::stoull( words[1] );
+            String msg = parse_memory_range( words, 2, stimulus.write );
+            if ( !msg.empty() )
+                return error( msg );
+            test.stimuli.push_back( stimulus );
+        } else if ( key == "serial_in" ) {
+            if ( !parse_bytes( words, 1, test.serial_input ) )
+                return error( "Invalid line '" + line + "'" );
+        } else if ( key == "serial_out" ) {
+            if ( !test.serial_output )
+                test.serial_output.emplace();
+            if ( !parse_bytes( words, 1, *test.serial_output ) )
+                return error( "Invalid line '" + line + "'" );
+        } else {
+            MemoryRange expectation;
+            String msg = parse_memory_range( words, 0, expectation );
+            if ( !msg.empty() )
+                return error( msg );
+            test.expectations.push_back( expectation );
+        }
+    }
+    std::stable_sort( test.stimuli.begin(), test.stimuli.end(),
+                      []( const Stimulus &a, const Stimulus &b ) { return a.cycle < b.cycle; } );
+    return true;
+}
+
+bool load_program( const String &file, Processor &processor ) {
+    if ( std::filesystem::path( file ).extension() != ".a51" )
+        return processor.load_hex_code( file );
+
+    std::ifstream stream( file );
+    if ( !stream.good() ) {
+        log( LogLevel::error, "Failed to open '" + file + "'" );
+        return false;
+    }
+    std::stringstream code;
+    code << stream.rdbuf();
+    if ( !compile_assembly( code.str(), processor ) ) {
+        log( LogLevel::error, "Failed to assemble '" + file + "'" );
+        return false;
+    }
+    return true;
+}
+
+bool is_halted( const Processor &processor ) {
+    return processor.text[processor.pc] == 0x80 && processor.text[static_cast<u16>( processor.pc + 1 )] == 0xFE;
+}
+
+/// Returns the byte of a memory range at "offset" (registers are resolved with the current register bank).
+template <typename ProcessorType>
+auto &range_byte( const MemoryRange &range, size_t offset, ProcessorType &processor ) {
+    u16 addr = range.addr + offset;
+    if ( range.is_register )
+        addr += processor.sfr[0xD0 - 0x80] & 0x18;
+    return range.space == MemSpace::xram  ? processor.xram[addr]
+           : range.space == MemSpace::sfr ? processor.sfr[addr - 0x80]
+                                          : processor.iram[addr];
+}
+
+bool run_test_case( const TestCase &test, Processor &processor, std::vector<u8> &serial_output ) {
+    processor.serial.input.assign( test.serial_input.begin(), test.serial_input.end() );
+    for ( auto &frame : processor.serial.input )
+        frame |= 0x100; // Stop bit or 9th data bit
+    serial_output.clear();
+    processor.serial.transmit = [&]( u8 byte, bool ) { serial_output.push_back( byte ); };
+
+    size_t next_stimulus = 0;
+    while ( true ) {
+        while ( next_stimulus < test.stimuli.size() && test.stimuli[next_stimulus].cycle <= processor.cycle_count ) {
+            auto &write = test.stimuli[next_stimulus++].write;
+            for ( size_t i = 0; i < write.bytes.size(); i++ )
+                range_byte( write, i, processor ) = write.bytes[i];
+        }
+        if ( is_halted( processor ) )
+            return true;
+        if ( processor.cycle_count >= test.max_cycles )
+            return false;
+        processor.do_cycle();
+    }
+}
+
+String check_test_case( const TestCase &test, const Processor &processor, const std::vector<u8> &serial_output ) {
+    String ret;
+    if ( test.cycles && *test.cycles != processor.cycle_count )
+        ret += "cycles: expected " + to_string( *test.cycles ) + ", got " + to_string( processor.cycle_count ) + "\n";
+    if ( test.pc && *test.pc != processor.pc )
+        ret += "pc: expected " + to_hex_str( *test.pc, 16 ) + ", got " + to_hex_str( processor.pc, 16 ) + "\n";
+    for ( auto &expectation : test.expectations ) {
+        String expected, actual;
+        for ( size_t i = 0; i < expectation.bytes.size(); i++ ) {
+            expected += " " + to_hex_str( expectation.bytes[i] );
+            actual += " " + to_hex_str( range_byte( expectation, i, processor ) );
+        }
+        if ( expected != actual )
+            ret += expectation.label + ": expected" + expected + ", got" + actual + "\n";
+    }
+    if ( test.serial_output && *test.serial_output != serial_output ) {
+        String expected, actual;
+        for ( u8 byte : *test.serial_output )
+            expected += " " + to_hex_str( byte );
+        for ( u8 byte : serial_output )
+            actual += " " + to_hex_str( byte );
+        ret += "serial_out: expected" + expected + ", got" + actual + "\n";
+    }
+    return ret;
+}
+
+/// Escapes the special characters of XML.
+String xml_escape( const String &str ) {
+    String ret;
+    for ( char c : str ) {
+        switch ( c ) {
+        case '<':
+            ret += "&lt;";
+            break;
+        case '>':
+            ret += "&gt;";
+            break;
+        case '&':
+            ret += "&amp;";
+            break;
+        case '"':
+            ret += "&quot;";
+            break;
+        default:
+            ret += c;
+        }
+    }
+    return ret;
+}
+
+void write_junit( std::ostream &output, const String &suite_name, const std::vector<TestResult> &results ) {
+    size_t failures = 0, errors = 0;
+    f64 seconds = 0;
+    for ( auto &result : results ) {
+        if ( result.error )
+            errors++;
+        else if ( !result.failure.empty() )
+            failures++;
+        seconds += result.seconds;
+    }
+
+    output << std::fixed << std::setprecision( 6 );
+    output << "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n";
+    output << "<testsuite name=\"" << xml_escape( suite_name ) << "\" tests=\"" << results.size() << "\" failures=\""
+           << failures << "\" errors=\"" << errors << "\" time=\"" << seconds << "\">\n";
+    for ( auto &result : results ) {
+        output << "  <testcase name=\"" << xml_escape( result.name ) << "\" classname=\"" << xml_escape( suite_name )
+               << "\" time=\"" << result.seconds << "\"";
+        if ( result.failure.empty() ) {
+            output << "/>\n";
+            continue;
+        }
+        String tag = result.error ? "error" : "failure";
+        String message = result.failure.substr( 0, result.failure.find( '\n' ) );
+        output << ">\n    <" << tag << " message=\"" << xml_escape( message ) << "\">" << xml_escape( result.failure )
+               << "</" << tag << ">\n  </testcase>\n";
+    }
+    output << "</testsuite>\n";
+}
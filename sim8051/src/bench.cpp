@@ -0,0 +1,470 @@
+#include "sim8051/stdafx.hpp"
+#include "sim8051/Processor.hpp"
+#include "sim8051/Assembler.hpp"
+#include "sim8051/Encoding.hpp"
+#include "sim8051/Logger.hpp"
+
+// Benchmark of the simulator core. Measures the host speed for classes of op codes, the example programs, synthetic
+// timer/interrupt workloads, the assembler and the hex loader and writes the results as JSON (optionally compared
+// against an older result file).
+
+/// Result of a single benchmark.
+struct BenchResult {
+    String name;
+    String kind; // "opcode_class", "example", "synthetic", "instrumentation", "assembler" or "loader".
+    size_t steps = 0; // Calls of do_cycle() (instructions and interrupt entries), source lines for the assembler, bytes
+                      // for the loader.
+    size_t cycles = 0; // Simulated machine cycles, source lines for the assembler, bytes for the loader.
+    f64 seconds = 0; // Best time of all repetitions.
+
+    f64 mips() const { return seconds > 0 ? steps / seconds / 1e6 : 0; }
+    f64 ns_per_cycle() const { return cycles > 0 ? seconds * 1e9 / cycles : 0; }
+};
+
+/// Instruction pattern which is repeated over the code memory.
+struct OpcodeClass {
+    const char *name;
+    std::vector<u8> pattern;
+};
+
+// All branches jump to the next instruction, so the patterns are position independent.
+const std::vector<OpcodeClass> opcode_classes = {
+    { "mov",
+      {
+          0x74, 0x55, // MOV A,#55
+          0xF8, // MOV R0,A
+          0xE9, // MOV A,R1
+          0xF5, 0x30, // MOV 30,A
+          0x85, 0x30, 0x31, // MOV 31,30
+          0x78, 0x40, // MOV R0,#40
+          0xF6, // MOV @R0,A
+          0xE6, // MOV A,@R0
+      } },
+    { "alu",
+      {
+          0x28, // ADD A,R0
+          0x34, 0x12, // ADDC A,#12
+          0x96, // SUBB A,@R0
+          0x09, // INC R1
+          0x65, 0x30, // XRL A,30
+          0x54, 0xF7, // ANL A,#F7
+          0x44, 0x08, // ORL A,#08
+          0x14, // DEC A
+          0xD4, // DA A
+          0x23, // RL A
+          0x33, // RLC A
+          0xC4, // SWAP A
+      } },
+    { "movx",
+      {
+          0xE0, // MOVX A,@DPTR
+          0xA3, // INC DPTR
+          0xF0, // MOVX @DPTR,A
+          0xE2, // MOVX A,@R0
+          0xF3, // MOVX @R1,A
+          0x08, // INC R0
+      } },
+    { "bit",
+      {
+          0xD3, // SETB C
+          0xB2, 0x20, // CPL 20
+          0x82, 0x21, // ANL C,21
+          0xA2, 0x22, // MOV C,22
+          0x92, 0x23, // MOV 23,C
+          0xC2, 0x24, // CLR 24
+          0xD2, 0x25, // SETB 25
+          0xB3, // CPL C
+          0x72, 0x26, // ORL C,26
+      } },
+    { "branch",
+      {
+          0x80, 0x00, // SJMP +0
+          0x60, 0x00, // JZ +0
+          0x70, 0x00, // JNZ +0
+          0x40, 0x00, // JC +0
+          0x50, 0x00, // JNC +0
+          0xB4, 0x55, 0x00, // CJNE A,#55,+0
+          0xDF, 0x00, // DJNZ R7,+0
+          0x20, 0x20, 0x00, // JB 20,+0
+          0x30, 0x21, 0x00, // JNB 21,+0
+      } },
+    { "muldiv",
+      {
+          0x75, 0xF0, 0x07, // MOV B,#07
+          0xA4, // MUL AB
+          0x75, 0xF0, 0x03, // MOV B,#03
+          0x84, // DIV AB
+      } },
+    { "call_stack",
+      {
+          0x12, 0xFF, 0xF0, // LCALL FFF0 (RET)
+          0xC0, 0xE0, // PUSH ACC
+          0xD0, 0xE0, // POP ACC
+      } },
+};
+
+// Timers 0 and 1 in 8 bit auto reload mode with interrupts every 16 and 32 cycles.
+const std::vector<std::pair<u16, std::vector<u8>>> timer_workload = {
+    { 0x0000, { 0x02, 0x00, 0x30 } }, // LJMP 0030
+    { 0x000B, { 0x0F, 0x32 } }, // INC R7; RETI
+    { 0x001B,
+      {
+          0xC0, 0xE0, // PUSH ACC
+          0xEE, // MOV A,R6
+          0x24, 0x03, // ADD A,#03
+          0xFE, // MOV R6,A
+          0xD0, 0xE0, // POP ACC
+          0x32, // RETI
+      } },
+    { 0x0030,
+      {
+          0x75, 0x89, 0x22, // MOV TMOD,#22
+          0x75, 0x9C, 0xF0, // MOV TH0,#F0
+          0x75, 0x9D, 0xE0, // MOV TH1,#E0
+          0x75, 0xA8, 0x8A, // MOV IE,#8A
+          0x75, 0x88, 0x50, // MOV TCON,#50
+          0x0D, // INC R5
+          0x80, 0xFD, // SJMP -3
+      } },
+};
+
+// Level triggered external interrupt 0 which is always pending, so an interrupt follows every instruction after RETI.
+const std::vector<std::pair<u16, std::vector<u8>>> interrupt_workload = {
+    { 0x0000, { 0x02, 0x00, 0x30 } }, // LJMP 0030
+    { 0x0003,
+      {
+          0x0B, // INC R3
+          0xE5, 0x30, // MOV A,30
+          0xF0, // MOVX @DPTR,A
+          0xA3, // INC DPTR
+          0x32, // RETI
+      } },
+    { 0x0030,
+      {
+          0x75, 0xA8, 0x81, // MOV IE,#81
+          0xC2, 0xB2, // CLR P3.2
+          0x0D, // INC R5
+          0x80, 0xFD, // SJMP -3
+      } },
+};
+
+/// Runs a prepared processor state for a number of steps and keeps the best time of all repetitions.
+BenchResult measure( const String &name, const String &kind, const Processor &initial, size_t steps,
+                     size_t repetitions ) {
+    BenchResult result;
+    result.name = name;
+    result.kind = kind;
+    result.steps = steps;
+    for ( size_t r = 0; r < repetitions; r++ ) {
+        auto processor = std::make_unique<Processor>( initial );
+        auto start = std::chrono::steady_clock::now();
+        for ( size_t i = 0; i < steps; i++ ) {
+            processor->do_cycle();
+        }
+        f64 seconds = std::chrono::duration<f64>( std::chrono::steady_clock::now() - start ).count();
+        if ( r == 0 || seconds < result.seconds ) {
+            result.seconds = seconds;
+            result.cycles = processor->cycle_count - initial.cycle_count;
+        }
+    }
+    return result;
+}
+
+/// Generates assembly source like a code generator would: blocks of instructions with all kinds of operands, local
+/// branches, calls and comments.
+String generate_assembly( size_t lines ) {
+    std::ostringstream source;
+    size_t count = 0;
+    for ( size_t block = 0; count < lines; block++ ) {
+        String label = "block" + to_string( block );
+        source << label << ":\n"
+               << "    mov a, r" << block % 8 << "\n"
+               << "    add a, " << to_hex_str( block & 0xff ) << "\n"
+               << "    mov (30), a ; store the sum\n"
+               << "    cjne a, 40, " << label << "\n"
+               << "    djnz r" << ( block + 3 ) % 8 << ", " << label << "\n"
+               << "    mov dptr, " << label << "\n"
+               << "    movc a, (a+dptr)\n"
+               << "    setb (20)\n"
+               << "    jnb (21), " << label << "\n"
+               << "    lcall " << label << "\n"
+               << "\tmov (31)\t(30)\n"
+               << "    xrl a, ff\n"
+               << "    sjmp " << label << "\n";
+        count += 14;
+    }
+    return source.str();
+}
+
+/// Assembles generated source and keeps the best time of all repetitions.
+BenchResult measure_assembler( size_t lines, size_t repetitions ) {
+    auto source = generate_assembly( lines );
+    BenchResult result;
+    result.name = "assembler";
+    result.kind = "assembler";
+    result.steps = std::count( source.begin(), source.end(), '\n' );
+    result.cycles = result.steps;
+    for ( size_t r = 0; r < repetitions; r++ ) {
+        Assembler assembler;
+        auto start = std::chrono::steady_clock::now();
+        if ( !assembler.assemble( source ) )
+            log( "Failed to assemble the generated source" );
+        f64 seconds = std::chrono::duration<f64>( std::chrono::steady_clock::now() - start ).count();
+        if ( r == 0 || seconds < result.seconds )
+            result.seconds = seconds;
+    }
+    return result;
+}
+
+/// Assembles generated source again after inserting or removing a line in the middle (like an edit in the editor), so
+/// only this line is assembled but the code behind it moves. Keeps the best time of all repetitions.
+BenchResult measure_assembler_edit( size_t lines, size_t repetitions ) {
+    auto source = generate_assembly( lines );
+    auto middle = source.find( '\n', source.size() / 2 ) + 1;
+    auto edited = source.substr( 0, middle ) + "    nop\n" + source.substr( middle );
+    BenchResult result;
+    result.name = "assembler_edit";
+    result.kind = "assembler";
+    result.steps = std::count( source.begin(), source.end(), '\n' );
+    result.cycles = result.steps;
+    Assembler assembler;
+    assembler.assemble( source );
+    for ( size_t r = 0; r < repetitions; r++ ) {
+        auto start = std::chrono::steady_clock::now();
+        if ( !assembler.assemble( r % 2 == 0 ? edited : source ) )
+            log( "Failed to assemble the edited source" );
+        f64 seconds = std::chrono::duration<f64>( std::chrono::steady_clock::now() - start ).count();
+        if ( r == 0 || seconds < result.seconds )
+            result.seconds = seconds;
+    }
+    return result;
+}
+
+/// Loads a hex file of the full code memory (written to the temporary directory) "images" times and keeps the best
+/// time of all repetitions.
+BenchResult measure_hex_loader( size_t images, size_t repetitions ) {
+    std::vector<u8> code( 64 * 1024 );
+    std::mt19937 random( 8051 );
+    for ( auto &byte : code )
+        byte = random();
+    auto file = ( std::filesystem::temp_directory_path() / "sim8051-bench.hex" ).string();
+    {
+        std::ofstream output( file );
+        encode_hex_file( code, output );
+    }
+
+    BenchResult result;
+    result.name = "hex_loader";
+    result.kind = "loader";
+    result.steps = images * code.size();
+    result.cycles = result.steps;
+    auto processor = std::make_unique<Processor>();
+    for ( size_t r = 0; r < repetitions; r++ ) {
+        auto start = std::chrono::steady_clock::now();
+        for ( size_t i = 0; i < images; i++ ) {
+            if ( !processor->load_hex_code( file ) )
+                log( "Failed to load the generated hex file" );
+        }
+        f64 seconds = std::chrono::duration<f64>( std::chrono::steady_clock::now() - start ).count();
+        if ( r == 0 || seconds < result.seconds )
+            result.seconds = seconds;
+    }
+    std::filesystem::remove( file );
+    return result;
+}
+
+/// Fills the lower half of the code memory with a pattern and jumps back to the start at the end.
+void load_pattern( Processor &processor, const std::vector<u8> &pattern ) {
+    processor.text.clear();
+    size_t end = 0x8000 - 0x8000 % pattern.size();
+    for ( size_t i = 0; i < end; i++ )
+        processor.text[i] = pattern[i % pattern.size()];
+    processor.text[end] = 0x02; // LJMP 0000
+    processor.text[0xFFF0] = 0x22; // RET (target of calls)
+    processor.full_reset();
+}
+
+void load_program( Processor &processor, const std::vector<std::pair<u16, std::vector<u8>>> &program ) {
+    processor.text.clear();
+    for ( auto &block : program )
+        std::copy( block.second.begin(), block.second.end(), processor.text.begin() + block.first );
+    processor.full_reset();
+}
+
+void write_json( std::ostream &output, const std::vector<BenchResult> &results ) {
+#ifdef NDEBUG
+    const char *build = "release";
+#else
+    const char *build = "debug";
+#endif
+    output << "{\n  \"build\": \"" << build << "\",\n  \"benchmarks\": [\n";
+    for ( size_t i = 0; i < results.size(); i++ ) {
+        auto &r = results[i];
+        // One benchmark per line, so the files can be diffed and read back easily.
+        output << "    { \"name\": \"" << r.name << "\", \"kind\": \"" << r.kind << "\", \"steps\": " << r.steps
+               << ", \"cycles\": " << r.cycles << ", \"seconds\": " << r.seconds << ", \"mips\": " << r.mips()
+               << ", \"ns_per_cycle\": " << r.ns_per_cycle() << " }" << ( i + 1 < results.size() ? "," : "" )
+               << '\n';
+    }
+    output << "  ]\n}\n";
+}
+
+/// Reads "ns_per_cycle" of all benchmarks from a file written by write_json(). Returns false if the file can't be read
+/// or contains no benchmark.
+bool read_baseline( const String &file, std::map<String, f64> &baseline ) {
+    std::ifstream input( file );
+    if ( !input.good() ) {
+        log( LogLevel::error, "Failed to open baseline '" + file + "'" );
+        return false;
+    }
+    String line;
+    while ( std::getline( input, line ) ) {
+        auto name_pos = line.find( "\"name\": \"" );
+        auto value_pos = line.find( "\"ns_per_cycle\": " );
+        if ( name_pos == line.npos || value_pos == line.npos )
+            continue;
+        name_pos += 9;
+        String name = line.substr( name_pos, line.find( '"', name_pos ) - name_pos );
+        baseline[name] = std::strtod( line.c_str() + value_pos + 16, nullptr );
+    }
+    if ( input.bad() || baseline.empty() ) {
+        log( LogLevel::error, "Baseline '" + file + "' contains no benchmarks" );
+        return false;
+    }
+    return true;
+}
+
+void print_usage() {
+    std::cerr << "Usage: sim8051-bench [--steps N] [--repeat N] [--examples dir] [--filter text] [--out results.json]\n"
+                 "                     [--baseline old.json] [--max-regression percent]\n"
+                 "  Runs every benchmark for N steps (default 2000000) and keeps the best of all repetitions\n"
+                 "  (default 3). With a baseline the exit code is 1 if any benchmark got slower (per simulated cycle)\n"
+                 "  by more than the allowed regression (default 5 percent) and 2 if the baseline can't be read.\n"
+                 "  Benchmarks which are not in the baseline are reported, but don't fail.\n";
+}
+
+int main( int argc, char **argv ) {
+    Logger logger( []( LogLevel, const String &message ) { std::cerr << message << '\n'; } );
+    logger.install();
+    size_t steps = 2000000;
+    size_t repetitions = 3;
+    String examples_dir = String( CMAKE_PROJECT_ROOT ) + "/examples";
+    String filter;
+    String out_file;
+    String baseline_file;
+    f64 max_regression = 5;
+    std::vector<String> args( argv + 1, argv + argc );
+    for ( size_t i = 0; i < args.size(); i++ ) {
+        if ( args[i] == "--steps" && i + 1 < args.size() ) {
+            steps = std::stoull( args[++i] );
+        } else if ( args[i] == "--repeat" && i + 1 < args.size() ) {
+            repetitions = std::max<size_t>( 1, std::stoull( args[++i] ) );
+        } else if ( args[i] == "--examples" && i + 1 < args.size() ) {
+            examples_dir = args[++i];
+        } else if ( args[i] == "--filter" && i + 1 < args.size() ) {
+            filter = args[++i];
+        } else if ( args[i] == "--out" && i + 1 < args.size() ) {
+            out_file = args[++i];
+        } else if ( args[i] == "--baseline" && i + 1 < args.size() ) {
+            baseline_file = args[++i];
+        } else if ( args[i] == "--max-regression" && i + 1 < args.size() ) {
+            max_regression = std::stod( args[++i] );
+        } else {
+            print_usage();
+            return 2;
+        }
+    }
+    // The baseline is read first, so a wrong file doesn't take a whole run to notice.
+    std::map<String, f64> baseline;
+    if ( !baseline_file.empty() && !read_baseline( baseline_file, baseline ) )
+        return 2;
+
+    std::vector<BenchResult> results;
+    auto processor = std::make_unique<Processor>();
+    processor->break_instruction = 0xA5; // Reserved instruction, i. e. no break instruction.
+    auto run = [&]( const String &name, const String &kind ) {
+        if ( name.find( filter ) == name.npos )
+            return;
+        results.push_back( measure( name, kind, *processor, steps, repetitions ) );
+        auto &r = results.back();
+        log( name + ": " + to_string( r.mips() ) + " MIPS, " + to_string( r.ns_per_cycle() ) + " ns/cycle" );
+    };
+
+    for ( auto &opcode_class : opcode_classes ) {
+        load_pattern( *processor, opcode_class.pattern );
+        run( opcode_class.name, "opcode_class" );
+    }
+
+    // Overhead of the tracked simulation variant (with one observer which does nothing).
+    load_pattern( *processor, opcode_classes[1].pattern );
+    processor->instrumentation.add_observer( []( const Event *, size_t ) {} );
+    run( "alu_observed", "instrumentation" );
+    processor->instrumentation = Instrumentation();
+
+    load_program( *processor, timer_workload );
+    run( "timer_interrupts", "synthetic" );
+    load_program( *processor, interrupt_workload );
+    run( "external_interrupts", "synthetic" );
+
+    std::vector<std::filesystem::path> examples;
+    if ( std::filesystem::is_directory( examples_dir ) ) {
+        for ( auto &entry : std::filesystem::directory_iterator( examples_dir ) ) {
+            if ( entry.path().extension() == ".hex" )
+                examples.push_back( entry.path() );
+        }
+    }
+    std::sort( examples.begin(), examples.end() );
+    for ( auto &example : examples ) {
+        if ( !processor->load_hex_code( example.string() ) )
+            return 1;
+        processor->full_reset();
+        run( "example_" + example.stem().string(), "example" );
+    }
+
+    if ( String( "assembler" ).find( filter ) != String::npos ) {
+        results.push_back( measure_assembler( 100000, repetitions ) );
+        auto &r = results.back();
+        log( r.name + ": " + to_string( r.steps / r.seconds / 1e6 ) + " million lines/s" );
+    }
+    if ( String( "assembler_edit" ).find( filter ) != String::npos ) {
+        results.push_back( measure_assembler_edit( 100000, repetitions ) );
+        auto &r = results.back();
+        log( r.name + ": " + to_string( r.seconds * 1e3 ) + " ms per edit" );
+    }
+    if ( String( "hex_loader" ).find( filter ) != String::npos ) {
+        results.push_back( measure_hex_loader( 100, repetitions ) );
+        auto &r = results.back();
+        log( r.name + ": " + to_string( r.steps / r.seconds / 1e6 ) + " MB/s" );
+    }
+
+    if ( out_file.empty() ) {
+        logger.flush(); // The results of the single benchmarks come first when both streams go to a terminal.
+        write_json( std::cout, results );
+    } else {
+        std::ofstream output( out_file );
+        write_json( output, results );
+        if ( !output.good() ) {
+            log( "Failed to write '" + out_file + "'" );
+            return 1;
+        }
+    }
+
+    if ( !baseline_file.empty() ) {
+        bool regressed = false;
+        for ( auto &r : results ) {
+            auto itr = baseline.find( r.name );
+            if ( itr == baseline.end() || itr->second <= 0 ) {
+                log( LogLevel::warning, r.name + ": not in the baseline" );
+                continue;
+            }
+            f64 change = ( r.ns_per_cycle() / itr->second - 1 ) * 100;
+            bool too_slow = change > max_regression;
+            regressed |= too_slow;
+            log( r.name + ": " + ( change >= 0 ? "+" : "" ) + to_string( change ) + "%" +
+                 ( too_slow ? " REGRESSION" : "" ) );
+        }
+        if ( regressed )
+            return 1;
+    }
+    return 0;
+}
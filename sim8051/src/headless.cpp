@@ -0,0 +1,467 @@
+#include "sim8051/stdafx.hpp"
+#include "sim8051/Processor.hpp"
+#include "sim8051/Encoding.hpp"
+#include "sim8051/Logger.hpp"
+#include "sim8051/Lockstep.hpp"
+#include "sim8051/Pacer.hpp"
+#include "sim8051/Profiler.hpp"
+#include "sim8051/Serial.hpp"
+#include "sim8051/TestCase.hpp"
+
+// Command line front end which runs the simulator without a GUI (e. g. on a build farm).
+
+// Writes the log messages to std::cerr. Its minimum level is raised to suppress the messages of the simulator (e. g.
+// invalid accesses of random programs).
+Logger logger( []( LogLevel, const String &message ) { std::cerr << message << '\n'; } );
+
+void print_usage() {
+    std::cerr << "Usage: sim8051-headless <command> [options]\n"
+                 "Commands:\n"
+                 "  run <file.hex> [--cycles N] [--break XX] [--coverage out.cov] [--trace out.txt]\n"
+                 "      [--uart pty] [--uart-in <file|->] [--uart-out <file|->] [--realtime RATIO] [--clock MHZ]\n"
+                 "      [--report <out.json|->] [--profile trace.json]\n"
+                 "      Simulates at most N machine cycles (default 1000000, 0 means no limit) or until the break\n"
+                 "      instruction XX is reached. Optionally stores the coverage of the run or a trace of all\n"
+                 "      events.\n"
+                 "      The report (JSON) contains the final PC and cycle count, the anomalies of the firmware\n"
+                 "      (invalid SFR accesses, divisions by zero, reserved instructions) and runtime statistics\n"
+                 "      (instruction mix, interrupts, timer overflows, MOVX accesses, idle time, host time).\n"
+                 "      --profile writes the timing of the simulator phases as Chrome trace (only in debug builds).\n"
+                 "      The serial port can be connected to a new pseudo-terminal (its name is printed) or to files\n"
+                 "      and pipes. With --realtime the simulation is paced to RATIO times real time (e. g. 1, 0.5 or\n"
+                 "      10) of a microcontroller with the given clock (default 12 MHz).\n"
+                 "  coverage-merge --image <file.hex> --out <report.info> [--listing <file.lst>] <file.cov|dir>...\n"
+                 "      Merges coverage files (or all *.cov files in a directory) into one lcov report.\n"
+                 "  lockstep [file.hex] [--engine tracked] [--seeds N] [--steps N] [--block N]\n"
+                 "      Runs the plain interpreter and another engine side by side and reports the first difference\n"
+                 "      in the state, which is compared every N steps (default 1). Without a file random programs\n"
+                 "      with the seeds 1 to N (default 100) are used, which must execute all op codes.\n"
+                 "  check <file.expect|dir>... [--jobs N] [--junit report.xml]\n"
+                 "      Runs programs until they halt and compares the final state and cycle count with the\n"
+                 "      expectations (all *.expect files in a directory). Runs N tests in parallel (default: one per\n"
+                 "      core) and optionally writes a JUnit report.\n";
+}
+
+/// Writes events as text lines: cycle, kind, address space, address and value.
+void write_trace( std::ostream &output, const Event *events, size_t count ) {
+    static const char *kind_names[] = { "fetch", "read", "write", "int_entry", "int_exit", "timer_overflow" };
+    for ( size_t i = 0; i < count; i++ ) {
+        auto &event = events[i];
+        output << event.cycle << ' ' << kind_names[event.kind] << ' ' << mem_space_name( event.space ) << ' '
+               << to_hex_str( event.addr, 16 ) << ' ' << to_hex_str( event.value ) << '\n';
+    }
+}
+
+/// Writes the result of a run as JSON.
+void write_report( std::ostream &output, const Processor &processor ) {
+    output << "{\n  \"pc\": " << processor.pc << ",\n  \"cycles\": " << processor.cycle_count
+           << ",\n  \"anomalies\": ";
+    processor.anomalies.write_json( output, 2 );
+    output << ",\n  \"stats\": ";
+    processor.stats.write_json( output, processor.cycle_count, 2 );
+    output << "\n}\n";
+}
+
+int run_command( const std::vector<String> &args ) {
+    String hex_file;
+    String report_file;
+    String profile_file;
+    String coverage_file;
+    String trace_file;
+    String uart_in;
+    String uart_out;
+    bool uart_pty = false;
+    std::optional<Pacer> pacer;
+    f64 clock_mhz = 12;
+    size_t max_cycles = 1000000;
+    Processor processor;
+    processor.break_instruction = 0xA5; // Reserved instruction, i. e. no break instruction.
+    for ( size_t i = 0; i < args.size(); i++ ) {
+        if ( args[i] == "--cycles" && i + 1 < args.size() ) {
+            max_cycles = std::stoull( args[++i] );
+        } else if ( args[i] == "--break" && i + 1 < args.size() ) {
+            processor.break_instruction = stoi( args[++i], 0, 16 );
+        } else if ( args[i] == "--coverage" && i + 1 < args.size() ) {
+            coverage_file = args[++i];
+        } else if ( args[i] == "--trace" && i + 1 < args.size() ) {
+            trace_file = args[++i];
+        } else if ( args[i] == "--report" && i + 1 < args.size() ) {
+            report_file = args[++i];
+        } else if ( args[i] == "--profile" && i + 1 < args.size() ) {
+            profile_file = args[++i];
+        } else if ( args[i] == "--uart" && i + 1 < args.size() && args[i + 1] == "pty" ) {
+            uart_pty = true;
+            i++;
+        } else if ( args[i] == "--uart-in" && i + 1 < args.size() ) {
+            uart_in = args[++i];
+        } else if ( args[i] == "--uart-out" && i + 1 < args.size() ) {
+            uart_out = args[++i];
+        } else if ( args[i] == "--realtime" && i + 1 < args.size() && stod( args[i + 1] ) > 0 ) {
+            pacer.emplace();
+            pacer->ratio = stod( args[++i] );
+        } else if ( args[i] == "--clock" && i + 1 < args.size() && stod( args[i + 1] ) > 0 ) {
+            clock_mhz = stod( args[++i] );
+        } else if ( hex_file.empty() ) {
+            hex_file = args[i];
+        } else {
+            print_usage();
+            return 2;
+        }
+    }
+    if ( hex_file.empty() ) {
+        print_usage();
+        return 2;
+    }
+
+    if ( !processor.load_hex_code( hex_file ) )
+        return 1;
+    processor.full_reset();
+    processor.record_coverage = !coverage_file.empty();
+
+    std::ofstream trace;
+    if ( !trace_file.empty() ) {
+        trace.open( trace_file );
+        if ( !trace.good() ) {
+            log( "Failed to open trace file '" + trace_file + "'" );
+            return 1;
+        }
+        processor.instrumentation.add_observer(
+            [&]( const Event *events, size_t count ) { write_trace( trace, events, count ); } );
+    }
+
+    SerialBridge bridge;
+    bool use_bridge = uart_pty || !uart_in.empty() || !uart_out.empty();
+    if ( uart_pty ) {
+        String device = bridge.open_pty();
+        if ( device.empty() )
+            return 1;
+        log( "Serial port: " + device );
+    } else if ( use_bridge && !bridge.open_files( uart_in, uart_out ) ) {
+        return 1;
+    }
+    if ( use_bridge )
+        bridge.attach( processor );
+
+    if ( pacer ) {
+        pacer->oscillator_hz = clock_mhz * 1e6;
+        pacer->start( processor.cycle_count );
+    }
+
+    bool hit_break = false;
+    processor.break_callback = [&]( auto && ) { hit_break = true; };
+    if ( !profile_file.empty() ) {
+        if ( Profiler::enabled )
+            profiler.start_trace();
+        else
+            log( LogLevel::warning, "The profiling zones are only compiled into debug builds." );
+    }
+    auto start_time = std::chrono::steady_clock::now();
+    for ( size_t steps = 0; !hit_break && ( max_cycles == 0 || processor.cycle_count < max_cycles ); steps++ ) {
+        if ( use_bridge && steps % 256 == 0 )
+            bridge.poll( processor );
+        processor.do_cycle();
+        if ( pacer )
+            pacer->pace( processor.cycle_count );
+    }
+    if ( use_bridge )
+        bridge.poll( processor );
+    processor.stats.host_seconds +=
+        std::chrono::duration<f64>( std::chrono::steady_clock::now() - start_time ).count();
+    processor.instrumentation.flush();
+    log( "Stopped at " + to_hex_str( processor.pc, 16 ) + " after " + to_string( processor.cycle_count ) +
+         " cycles." );
+    if ( pacer ) {
+        log( "Achieved " + to_string( pacer->achieved_ratio( processor.cycle_count ) ) +
+             " times real time (worst lag " + to_string( pacer->worst_lag * 1000 ) + " ms, " +
+             to_string( pacer->restarts ) + " restarts)." );
+    }
+    if ( processor.anomalies.total() > 0 )
+        log( LogLevel::warning, to_string( processor.anomalies.total() ) + " anomalies (see --report)." );
+
+    if ( profiler.is_tracing() ) {
+        std::ofstream trace_output( profile_file );
+        if ( !profiler.write_trace( trace_output ) || !trace_output.good() ) {
+            log( LogLevel::error, "Failed to write profile '" + profile_file + "'" );
+            return 1;
+        }
+    }
+
+    if ( report_file == "-" ) {
+        logger.flush(); // The messages of the run come first when both streams go to a terminal.
+        write_report( std::cout, processor );
+    } else if ( !report_file.empty() ) {
+        std::ofstream report( report_file );
+        write_report( report, processor );
+        if ( !report.good() ) {
+            log( LogLevel::error, "Failed to write report '" + report_file + "'" );
+            return 1;
+        }
+    }
+
+    if ( !coverage_file.empty() && !processor.coverage.save( coverage_file ) )
+        return 1;
+    return 0;
+}
+
+int coverage_merge_command( const std::vector<String> &args ) {
+    String hex_file;
+    String out_file;
+    String listing_file;
+    std::vector<String> inputs;
+    for ( size_t i = 0; i < args.size(); i++ ) {
+        if ( args[i] == "--image" && i + 1 < args.size() ) {
+            hex_file = args[++i];
+        } else if ( args[i] == "--out" && i + 1 < args.size() ) {
+            out_file = args[++i];
+        } else if ( args[i] == "--listing" && i + 1 < args.size() ) {
+            listing_file = args[++i];
+        } else if ( std::filesystem::is_directory( args[i] ) ) {
+            for ( auto &entry : std::filesystem::directory_iterator( args[i] ) ) {
+                if ( entry.path().extension() == ".cov" )
+                    inputs.push_back( entry.path().string() );
+            }
+        } else {
+            inputs.push_back( args[i] );
+        }
+    }
+    if ( hex_file.empty() || out_file.empty() ) {
+        print_usage();
+        return 2;
+    }
+
+    Processor processor;
+    if ( !processor.load_hex_code( hex_file ) )
+        return 1;
+
+    // Coverage is only or-ed, so the files can be processed one after another.
+    Coverage merged;
+    Coverage run;
+    for ( auto &input : inputs ) {
+        if ( !run.load( input ) )
+            return 1;
+        merged.merge( run );
+    }
+
+    if ( listing_file.empty() )
+        listing_file = out_file + ".lst";
+    std::ofstream listing( listing_file );
+    merged.write_listing( listing, processor );
+    std::ofstream report( out_file );
+    merged.write_lcov( report, processor, std::filesystem::absolute( listing_file ).string() );
+    if ( !listing.good() || !report.good() ) {
+        log( "Failed to write coverage report." );
+        return 1;
+    }
+    log( "Merged " + to_string( inputs.size() ) + " coverage files." );
+    return 0;
+}
+
+int lockstep_command( const std::vector<String> &args ) {
+    String hex_file;
+    String engine = "tracked";
+    u32 seeds = 100;
+    size_t steps = 10000;
+    size_t block_size = 1;
+    for ( size_t i = 0; i < args.size(); i++ ) {
+        if ( args[i] == "--engine" && i + 1 < args.size() ) {
+            engine = args[++i];
+        } else if ( args[i] == "--seeds" && i + 1 < args.size() ) {
+            seeds = std::stoul( args[++i] );
+        } else if ( args[i] == "--steps" && i + 1 < args.size() ) {
+            steps = std::stoull( args[++i] );
+        } else if ( args[i] == "--block" && i + 1 < args.size() ) {
+            block_size = std::stoull( args[++i] );
+        } else if ( hex_file.empty() ) {
+            hex_file = args[i];
+        } else {
+            print_usage();
+            return 2;
+        }
+    }
+
+    // The candidate engines which can be checked against the plain interpreter.
+    std::function<void( Processor & )> setup_candidate;
+    if ( engine == "tracked" ) {
+        // Memory access tracking (watchpoints and instrumentation) runs a separate variant of the interpreter.
+        setup_candidate = []( Processor &p ) { p.instrumentation.add_observer( []( const Event *, size_t ) {} ); };
+    } else {
+        log( "Unknown engine '" + engine + "'" );
+        return 2;
+    }
+    StepFunction step = []( Processor &p ) { p.do_cycle(); };
+
+    auto reference = std::make_unique<Processor>();
+    reference->break_instruction = 0xA5; // Reserved instruction, i. e. no break instruction.
+    std::array<size_t, 256> executed_opcodes = {};
+    u32 runs = hex_file.empty() ? seeds : 1;
+    for ( u32 seed = 1; seed <= runs; seed++ ) {
+        if ( hex_file.empty() ) {
+            generate_random_program( *reference, seed );
+        } else {
+            if ( !reference->load_hex_code( hex_file ) )
+                return 1;
+            reference->full_reset();
+        }
+        auto candidate = std::make_unique<Processor>( *reference );
+        setup_candidate( *candidate );
+
+        logger.min_level = LogLevel::off;
+        auto divergence =
+            run_lockstep( *reference, *candidate, step, step, steps, block_size, &executed_opcodes );
+        logger.min_level = LogLevel::debug;
+        if ( divergence ) {
+            log( "Divergence" + ( hex_file.empty() ? " with seed " + to_string( seed ) : String() ) + " after " +
+                 to_string( divergence->step ) + " steps at " + to_hex_str( divergence->pc, 16 ) + ": " +
+                 divergence->instruction + "\n" + divergence->diff );
+            return 1;
+        }
+    }
+
+    size_t covered = 0;
+    String missing;
+    for ( size_t opcode = 0; opcode < 256; opcode++ ) {
+        if ( opcode == 0xA5 )
+            continue; // Reserved
+        if ( executed_opcodes[opcode] > 0 )
+            covered++;
+        else
+            missing += " " + to_hex_str( opcode );
+    }
+    log( "No divergence in " + to_string( runs ) + " runs. Executed " + to_string( covered ) + " of 255 op codes." );
+    if ( hex_file.empty() && !missing.empty() ) {
+        log( "Missing op codes:" + missing );
+        return 1;
+    }
+    return 0;
+}
+
+int check_command( const std::vector<String> &args ) {
+    std::vector<String> files;
+    String junit_file;
+    size_t jobs = std::max( std::thread::hardware_concurrency(), 1u );
+    for ( size_t i = 0; i < args.size(); i++ ) {
+        if ( args[i] == "--jobs" && i + 1 < args.size() ) {
+            jobs = std::max<size_t>( std::stoull( args[++i] ), 1 );
+        } else if ( args[i] == "--junit" && i + 1 < args.size() ) {
+            junit_file = args[++i];
+        } else if ( std::filesystem::is_directory( args[i] ) ) {
+            std::vector<String> dir_files;
+            for ( auto &entry : std::filesystem::directory_iterator( args[i] ) ) {
+                if ( entry.path().extension() == ".expect" )
+                    dir_files.push_back( entry.path().string() );
+            }
+            std::sort( dir_files.begin(), dir_files.end() );
+            files.insert( files.end(), dir_files.begin(), dir_files.end() );
+        } else {
+            files.push_back( args[i] );
+        }
+    }
+    if ( files.empty() ) {
+        print_usage();
+        return 2;
+    }
+
+    // Every program is loaded once into a reset processor. The test cases start from this snapshot, which only copies
+    // the pages of the memories which were used.
+    std::vector<TestCase> tests( files.size() );
+    std::vector<TestResult> results( files.size() );
+    std::map<String, std::unique_ptr<Processor>> snapshots;
+    for ( size_t i = 0; i < files.size(); i++ ) {
+        auto &test = tests[i];
+        auto &result = results[i];
+        result.name = std::filesystem::path( files[i] ).stem().string();
+        if ( !load_test_case( files[i], test ) ) {
+            result.error = true;
+            result.failure = "invalid test case";
+            continue;
+        }
+        auto itr = snapshots.find( test.program );
+        if ( itr == snapshots.end() ) {
+            auto snapshot = std::make_unique<Processor>();
+            if ( load_program( test.program, *snapshot ) )
+                snapshot->full_reset();
+            else
+                snapshot.reset(); // Remember the failure.
+            itr = snapshots.emplace( test.program, std::move( snapshot ) ).first;
+        }
+        if ( !itr->second ) {
+            result.error = true;
+            result.failure = "failed to load '" + test.program + "'";
+        }
+    }
+
+    std::atomic<size_t> next_test = 0;
+    auto worker = [&]() {
+        auto processor = std::make_unique<Processor>();
+        processor->break_instruction = 0xA5; // Reserved instruction, i. e. no break instruction.
+        std::vector<u8> serial_output;
+        for ( size_t i = next_test++; i < tests.size(); i = next_test++ ) {
+            auto &test = tests[i];
+            auto &result = results[i];
+            if ( result.error )
+                continue;
+            auto start = std::chrono::steady_clock::now();
+            processor->restore( *snapshots.at( test.program ) );
+            if ( !run_test_case( test, *processor, serial_output ) )
+                result.failure = "did not halt within " + to_string( test.max_cycles ) + " cycles\n";
+            result.failure += check_test_case( test, *processor, serial_output );
+            if ( !result.failure.empty() )
+                result.failure.pop_back(); // Trailing line break
+            result.cycles = processor->cycle_count;
+            result.seconds = std::chrono::duration<f64>( std::chrono::steady_clock::now() - start ).count();
+        }
+    };
+    std::vector<std::thread> threads;
+    for ( size_t i = 1; i < std::min( jobs, tests.size() ); i++ )
+        threads.emplace_back( worker );
+    worker();
+    for ( auto &thread : threads )
+        thread.join();
+
+    size_t failed = 0;
+    for ( auto &result : results ) {
+        if ( result.failure.empty() ) {
+            log( "PASS " + result.name + " (" + to_string( result.cycles ) + " cycles)" );
+        } else {
+            String details;
+            std::stringstream lines( result.failure );
+            for ( String line; std::getline( lines, line ); )
+                details += "\n  " + line;
+            log( "FAIL " + result.name + details );
+            failed++;
+        }
+    }
+    log( to_string( files.size() - failed ) + " of " + to_string( files.size() ) + " tests passed." );
+
+    if ( !junit_file.empty() ) {
+        std::ofstream junit( junit_file );
+        write_junit( junit, "sim8051", results );
+        if ( !junit.good() ) {
+            log( "Failed to write JUnit report '" + junit_file + "'" );
+            return 1;
+        }
+    }
+    return failed == 0 ? 0 : 1;
+}
+
+int main( int argc, char **argv ) {
+    logger.install();
+    if ( argc < 2 ) {
+        print_usage();
+        return 2;
+    }
+    String command = argv[1];
+    std::vector<String> args( argv + 2, argv + argc );
+
+    if ( command == "run" ) {
+        return run_command( args );
+    } else if ( command == "coverage-merge" ) {
+        return coverage_merge_command( args );
+    } else if ( command == "lockstep" ) {
+        return lockstep_command( args );
+    } else if ( command == "check" ) {
+        return check_command( args );
+    }
+    print_usage();
+    return 2;
+}
@@ -1,6 +1,13 @@
 #include "sim8051/stdafx.hpp"
 #include "sim8051/Processor.hpp"
+#include "sim8051/Assembler.hpp"
 #include "sim8051/Encoding.hpp"
+#include "sim8051/InstructionSet.hpp"
+#include "sim8051/Logger.hpp"
+#include "sim8051/Simulation.hpp"
+#include "sim8051/MemoryView.hpp"
+#include "sim8051/CodeMap.hpp"
+#include "sim8051/Profiler.hpp"
 
 #include "SFML/System.hpp"
 #include "SFML/Window.hpp"
@@ -9,16 +16,18 @@
 #include "imgui.h"
 #include "misc/cpp/imgui_stdlib.h"
 
-std::deque<String> global_log;
-sf::Clock last_global_log_timer;
+/// Message in the Log window.
+struct LogLine {
+    LogLevel level;
+    String text;
+};
 
-char to_human_readable_ascii( u8 c ) {
-    if ( c < ' ' || c >= 0x7f ) {
-        return '.';
-    } else {
-        return c;
-    }
-}
+constexpr size_t max_log_lines = 10000; // Older messages are removed from the Log window.
+std::deque<LogLine> global_log;
+size_t global_log_count = 0; // Messages which were ever added to global_log.
+sf::Clock last_global_log_timer;
+std::mutex pending_log_mutex;
+std::vector<LogLine> pending_log; // Messages from the logger thread, moved to global_log by the GUI thread.
 
 String int_to_ui_string( u16 val, u8 bit = 8 ) {
     if ( bit == 8 ) {
@@ -34,6 +43,12 @@ String int_to_ui_string( u16 val, u8 bit = 8 ) {
 // The main loop, including some stuff like scrolling
 int main() {
     // Initialize all the stuff
+    Logger logger( []( LogLevel level, const String &message ) {
+        std::cout << message << '\n';
+        std::lock_guard<std::mutex> lock( pending_log_mutex );
+        pending_log.push_back( { level, message } );
+    } );
+    logger.install();
     sf::ContextSettings context_settings{ 0, 0, 4 };
     sf::RenderWindow window( sf::VideoMode( sf::Vector2u( 1200, 800 ), 32 ), "Sim8051", sf::State::Windowed,
                              context_settings );
@@ -47,7 +62,7 @@ int main() {
     }
     sf::Clock timer;
     last_global_log_timer.restart();
-    size_t last_log_size = global_log.size();
+    size_t last_log_count = global_log_count;
     size_t last_pc = 0;
     bool should_save = false;
     bool should_compile = false;
@@ -62,36 +77,125 @@ int main() {
 
 
     // Simulation stuff
-    size_t steps_per_frame = 0;
-    bool pause_next_frame = false;
-    bool max_speed = false;
-    u32 fix_target_frequency = 12000;
-    bool use_fix_target_frequency = false;
-    std::vector<u16> op_code_indices; // Pointers to the op codes.
-    auto processor = std::make_shared<Processor>();
+    int real_time_ratio = 1; // Index into real_time_ratios.
+    static const f64 real_time_ratios[] = { 0.5, 1, 10 };
+    f32 clock_mhz = 12;
+    CodeMap code_map; // Instructions and data of the program.
+    std::vector<u16> listing_rows; // Addresses of the rows in the Assembly window.
+    Bitmap<CodeMap::size> listed_instructions; // Rows of listing_rows which are instructions.
+    std::vector<DisassemblyRow> disassembly_rows; // Of listing_rows, decoded when they are shown first.
+    size_t program_version = 0; // Of the memory views.
+    MemoryView text_view( decltype( Processor::text )::size() );
+    MemoryView xram_view( decltype( Processor::xram )::size() );
+    MemoryView iram_view( std::tuple_size<decltype( Processor::iram )>::value );
+    const u32 change_fade_frames = 90; // Changed bytes are highlighted for this many frames.
+    auto simulation = std::make_unique<Simulation>();
     String hex_filename = "tests/hello.hex";
     String editor_asm_filename = "tests/hello.a51";
     String editor_hex_file_dir = "tests";
+    bool editor_write_hex = false; // Write a hex file on every compile (the program is loaded directly).
     String editor_content = "";
+    Assembler editor_assembler; // Keeps the result of every line, so only edited lines are assembled again.
+    bool editor_program_loaded = false; // The simulation runs the code of editor_assembler, so edits are patched in.
+    String coverage_filename = "tests/hello.cov";
+    String stats_filename = "tests/stats.json";
+    String trace_filename = "tests/trace.json";
+    constexpr size_t zone_count = static_cast<size_t>( Zone::count );
+    std::array<ZoneTotals, zone_count> profile_last = {}; // Totals at the start of the current interval.
+    std::array<ZoneTotals, zone_count> profile_interval = {}; // Of the last complete interval.
+    sf::Clock profile_clock; // Time of the current interval.
+    f64 profile_seconds = 1; // Length of the last complete interval.
+    int watch_space = static_cast<int>( MemSpace::xram );
+    String watch_addr_str = "0000";
+    bool watch_read = false;
+    bool watch_write = true;
+    String break_condition_str = "";
+    int break_ignore_count = 0;
 
     // Load simulation hex.
-    if ( processor->load_hex_code( hex_filename ) )
-        decode_instructions( *processor, op_code_indices );
-
-    // Breakpoint callback
-    processor->break_callback = [&]( auto &&processor ) {
-        steps_per_frame = steps_per_frame == 0;
-        max_speed = false;
-        use_fix_target_frequency = false;
-        log( "Hit breakpoint at instruction '" + to_hex_str( processor.pc ) + "'" );
+    simulation->load( hex_filename );
+    simulation->set_pacing( real_time_ratios[real_time_ratio], clock_mhz * 1e6 );
+
+    // Starts a step (or run to cursor), which is then executed at full speed by the simulation thread.
+    auto start_step = [&]( Simulation::Command start ) {
+        simulation->set_mode( Simulation::Mode::paused );
+        simulation->execute( std::move( start ) );
+    };
+    auto single_step = [&] {
+        simulation->set_mode( Simulation::Mode::paused );
+        simulation->execute( []( Processor &processor ) { processor.do_cycle(); } );
+    };
+
+    // Lists the rows of the Assembly window again. Decoded rows which are still at the same address, have the same size
+    // and kind and whose bytes are outside the changed range are kept.
+    auto relist = [&]( std::pair<size_t, size_t> changed ) {
+        auto rows = code_map.list();
+        std::vector<DisassemblyRow> decoded( rows.size() );
+        size_t old = 0;
+        for ( size_t i = 0; i < rows.size(); i++ ) {
+            while ( old < listing_rows.size() && listing_rows[old] < rows[i] )
+                old++;
+            size_t end = i + 1 < rows.size() ? rows[i + 1] : CodeMap::size;
+            size_t old_end = old + 1 < listing_rows.size() ? listing_rows[old + 1] : CodeMap::size;
+            if ( old < listing_rows.size() && listing_rows[old] == rows[i] && old_end == end &&
+                 listed_instructions.test( rows[i] ) == code_map.instructions.test( rows[i] ) &&
+                 ( end <= changed.first || rows[i] >= changed.second ) )
+                decoded[i] = std::move( disassembly_rows[old] );
+        }
+        listing_rows = std::move( rows );
+        disassembly_rows = std::move( decoded );
+        listed_instructions = code_map.instructions;
     };
 
     // Main loop
     while ( running ) {
         // Calculate delta time
         auto delta_time = timer.restart();
+        ProfileZone frame_zone( Zone::frame );
+        ProfileZone phase_zone( Zone::frame_sync );
+
+        // State of the simulation thread (read-only, changes are sent as commands)
+        auto &snapshot = simulation->snapshot();
+        const auto *processor = &snapshot.processor;
+        bool is_running = snapshot.mode != Simulation::Mode::paused || snapshot.stepping;
+        // A loaded program is decoded from scratch (without the entry points of the previous one). Code memory also
+        // changes with edits, then only the affected rows of the Assembly window are decoded again.
+        std::pair<size_t, size_t> changed_code{ 0, 0 };
+        if ( program_version != snapshot.program_version ) {
+            code_map.build( *processor );
+            changed_code = { 0, CodeMap::size };
+        } else {
+            changed_code = code_map.update( *processor );
+        }
+        if ( changed_code.first != changed_code.second ) {
+            relist( changed_code );
+        } else if ( !code_map.instructions.test( processor->pc ) && code_map.add_entry_point( processor->pc ) ) {
+            relist( changed_code ); // Executed code which wasn't reachable by decoding (e. g. by JMP @A+DPTR).
+        }
+        if ( program_version != snapshot.program_version ) {
+            program_version = snapshot.program_version;
+            text_view.reset( processor->text.data() );
+            xram_view.reset( processor->xram.data() );
+            iram_view.reset( processor->iram.data() );
+        } else {
+            text_view.update( processor->text.data() );
+            xram_view.update( processor->xram.data() );
+            iram_view.update( processor->iram.data() );
+        }
+        {
+            std::lock_guard<std::mutex> lock( pending_log_mutex );
+            if ( !pending_log.empty() )
+                last_global_log_timer.restart();
+            global_log_count += pending_log.size();
+            for ( auto &line : pending_log )
+                global_log.push_back( std::move( line ) );
+            pending_log.clear();
+            while ( global_log.size() > max_log_lines )
+                global_log.pop_front();
+        }
 
         // Event handling
+        phase_zone.next( Zone::frame_events );
         while ( const std::optional evt = window.pollEvent() ) {
             ImGui::SFML::ProcessEvent( window, *evt );
             bool not_on_gui = !ImGui::IsAnyItemHovered() && !ImGui::IsWindowHovered( ImGuiHoveredFlags_AnyWindow );
@@ -104,21 +208,21 @@ int main() {
                 if ( not_key_insert_gui ) {
                     // Key input
                     if ( key_pressed->code == sf::Keyboard::Key::Space ) {
-                        // Single step
-                        steps_per_frame = 1;
-                        pause_next_frame = true;
-                        max_speed = false;
-                        use_fix_target_frequency = false;
+                        single_step();
+                    } else if ( key_pressed->code == sf::Keyboard::Key::N ) {
+                        start_step( []( Processor &processor ) { processor.step_over(); } );
+                    } else if ( key_pressed->code == sf::Keyboard::Key::O ) {
+                        start_step( []( Processor &processor ) { processor.step_out(); } );
                     } else if ( key_pressed->code == sf::Keyboard::Key::R ) {
                         if ( key_pressed->shift ) {
-                            processor->full_reset();
+                            simulation->execute( []( Processor &processor ) { processor.full_reset(); } );
                         } else {
-                            processor->reset();
+                            simulation->execute( []( Processor &processor ) { processor.reset(); } );
                         }
                     } else if ( key_pressed->code == sf::Keyboard::Key::P ) {
-                        max_speed = false;
-                        steps_per_frame = steps_per_frame == 0 ? 1 : 0;
-                        use_fix_target_frequency = key_pressed->shift;
+                        simulation->set_mode( snapshot.mode != Simulation::Mode::paused ? Simulation::Mode::paused
+                                              : key_pressed->shift                      ? Simulation::Mode::real_time
+                                                                                        : Simulation::Mode::animated );
                     } else if ( key_pressed->code == sf::Keyboard::Key::L ) {
                         should_compile = true;
                         should_load = true;
@@ -138,84 +242,103 @@ int main() {
         }
 
         // Updating
+        phase_zone.next( Zone::frame_windows );
 
         ImGui::SFML::Update( window, delta_time );
 
-        // Simulation
-        for ( size_t i = 0; i < steps_per_frame; i++ ) {
-            processor->do_cycle();
-        }
-        if ( pause_next_frame ) {
-            pause_next_frame = false;
-            steps_per_frame = 0;
-        } else if ( max_speed ) {
-            if ( delta_time.asSeconds() < 1.f / 40.f ) {
-                steps_per_frame = steps_per_frame * 1.2 + 1;
-            } else {
-                steps_per_frame = std::max<u32>( 1, steps_per_frame / 1.2 );
-            }
-        } else if ( use_fix_target_frequency ) {
-            steps_per_frame = delta_time.asSeconds() * fix_target_frequency;
-        }
-
         // Gui
         ImGui::DockSpaceOverViewport();
 
         ImGui::Begin( "Control" );
-        ImGui::Text( String( "Cycle count: " + to_string( processor->cycle_count ) +
-                             ( steps_per_frame == 0 ? " (Paused)" : "" ) )
+        ImGui::Text( String( "Cycle count: " + to_string( processor->cycle_count ) + ( is_running ? "" : " (Paused)" ) )
                          .c_str() );
-        ImGui::Text( String( "Cycles per frame: " + to_string( steps_per_frame ) ).c_str() );
+        if ( snapshot.mode == Simulation::Mode::real_time ) {
+            ImGui::Text( String( "Real time ratio: " + to_string( snapshot.real_time_ratio ) + " (worst lag " +
+                                 to_string( snapshot.worst_lag * 1000 ) + " ms)" )
+                             .c_str() );
+        }
         ImGui::Text( String( "Frames per second: " + to_string( 1.f / delta_time.asSeconds() ) ).c_str() );
-        if ( ImGui::Button( steps_per_frame != 0 ? "Pause" : "Run" ) ) {
-            steps_per_frame = steps_per_frame == 0 ? 1 : 0;
-            max_speed = false;
-            use_fix_target_frequency = false;
+        if ( ImGui::Button( is_running ? "Pause" : "Run" ) ) {
+            simulation->set_mode( is_running ? Simulation::Mode::paused : Simulation::Mode::animated );
+            simulation->execute( []( Processor &processor ) { processor.cancel_step(); } );
         }
         if ( ImGui::Button( "Single step" ) ) {
-            steps_per_frame = 1;
-            pause_next_frame = true;
-            max_speed = false;
-            use_fix_target_frequency = false;
+            single_step();
+        }
+        ImGui::SameLine();
+        if ( ImGui::Button( "Step over" ) ) {
+            start_step( []( Processor &processor ) { processor.step_over(); } );
+        }
+        ImGui::SameLine();
+        if ( ImGui::Button( "Step out" ) ) {
+            start_step( []( Processor &processor ) { processor.step_out(); } );
         }
         if ( ImGui::Button( "Max speed" ) ) {
-            max_speed = true;
-            use_fix_target_frequency = false;
+            simulation->set_mode( Simulation::Mode::max_speed );
+        }
+        if ( ImGui::Button( "Run (real time)" ) ) {
+            simulation->set_mode( Simulation::Mode::real_time );
         }
-        if ( ImGui::Button( "Run (12 MHz)" ) ) {
-            max_speed = false;
-            use_fix_target_frequency = true;
+        ImGui::SameLine();
+        ImGui::SetNextItemWidth( 80 );
+        bool pacing_changed = ImGui::Combo( "##Ratio", &real_time_ratio, "0.5x\0" "1x\0" "10x\0" );
+        ImGui::SameLine();
+        ImGui::SetNextItemWidth( 80 );
+        if ( ImGui::InputFloat( "MHz", &clock_mhz, 0, 0, "%.4f" ) ) {
+            clock_mhz = std::max( clock_mhz, 0.001f );
+            pacing_changed = true;
         }
+        if ( pacing_changed )
+            simulation->set_pacing( real_time_ratios[real_time_ratio], clock_mhz * 1e6 );
         if ( ImGui::Button( "Reset (Pin)" ) ) {
-            processor->reset();
+            simulation->execute( []( Processor &processor ) { processor.reset(); } );
         }
         if ( ImGui::Button( "Reset MCU (full)" ) ) {
-            processor->full_reset();
+            simulation->execute( []( Processor &processor ) { processor.full_reset(); } );
         }
         ImGui::Spacing();
         if ( ImGui::InputText( "Hex file", &hex_filename, ImGuiInputTextFlags_EnterReturnsTrue ) |
              ImGui::Button( "Load" ) ) {
-            steps_per_frame = 0;
-            max_speed = false;
-            use_fix_target_frequency = false;
-            if ( processor->load_hex_code( hex_filename ) ) {
-                decode_instructions( *processor, op_code_indices );
-                log( "Loaded hex file" );
-            }
+            simulation->load( hex_filename );
+            editor_program_loaded = false;
         }
 
         ImGui::Spacing();
         String break_instr_str = to_hex_str( processor->break_instruction );
         if ( ImGui::InputText( "Break instruction", &break_instr_str, ImGuiInputTextFlags_EnterReturnsTrue ) ) {
-            processor->break_instruction = stoi( break_instr_str, 0, 16 );
+            u8 break_instruction = stoi( break_instr_str, 0, 16 );
+            simulation->execute( [=]( Processor &processor ) { processor.break_instruction = break_instruction; } );
+        }
+
+        ImGui::Spacing();
+        bool record_coverage = processor->record_coverage;
+        if ( ImGui::Checkbox( "Record coverage", &record_coverage ) )
+            simulation->execute( [=]( Processor &processor ) { processor.record_coverage = record_coverage; } );
+        ImGui::InputText( "Coverage file", &coverage_filename );
+        if ( ImGui::Button( "Save coverage" ) ) {
+            if ( processor->coverage.save( coverage_filename ) )
+                log( "Saved coverage" );
+        }
+        ImGui::SameLine();
+        if ( ImGui::Button( "Export lcov" ) ) {
+            std::ofstream listing( coverage_filename + ".lst" );
+            processor->coverage.write_listing( listing, *processor );
+            std::ofstream report( coverage_filename + ".info" );
+            processor->coverage.write_lcov( report, *processor,
+                                            std::filesystem::absolute( coverage_filename + ".lst" ).string() );
+            log( "Exported lcov report" );
+        }
+        ImGui::SameLine();
+        if ( ImGui::Button( "Clear coverage" ) ) {
+            simulation->execute( []( Processor &processor ) { processor.coverage.clear(); } );
         }
 
         ImGui::Spacing();
         if ( ImGui::Button( "Interrupt 0" ) ) {
-            processor->set_bit_to( 0xB2, 0 );
+            simulation->execute( []( Processor &processor ) { processor.set_bit_to( 0xB2, 0 ); } );
         }
         if ( ImGui::Button( "Interrupt 1" ) ) {
-            processor->set_bit_to( 0xB3, 0 );
+            simulation->execute( []( Processor &processor ) { processor.set_bit_to( 0xB3, 0 ); } );
         }
 
         ImGui::End();
@@ -271,114 +394,248 @@ int main() {
 
         ImGui::End();
 
-        ImGui::Begin( "Text (ROM)" );
-        {
+        // Hex dumps of the memories, recently changed bytes fade from orange to the text color.
+        auto draw_memory_view = [&]( const char *title, MemoryView &view ) {
+            ImGui::Begin( title );
             ImGui::PushStyleVar( ImGuiStyleVar_ItemSpacing, ImVec2( 0, 0 ) );
             ImGuiListClipper clipper;
-            clipper.Begin( processor->text.size() / 8 );
+            clipper.Begin( view.row_count() );
             while ( clipper.Step() ) {
                 for ( size_t i = clipper.DisplayStart; i < clipper.DisplayEnd; i++ ) {
-                    String line = "Addr " + to_hex_str( i * 8 ) + ": ";
-                    String ascii = "  |  ";
-                    for ( size_t j = 0; j < 8; j++ ) {
-                        u8 byte = processor->text[i * 8 + j];
-                        line += " " + to_hex_str( byte );
-                        ascii +=
-                            ( to_human_readable_ascii( byte ) == '%' ? String( "%%" )
-                                                                     : String( 1, to_human_readable_ascii( byte ) ) );
+                    const char *line = view.row_text( i ).c_str();
+                    if ( view.row_age( i ) >= change_fade_frames ) {
+                        ImGui::TextUnformatted( line );
+                        continue;
                     }
-                    line += ascii;
-                    ImGui::Text( line.c_str() );
+                    ImGui::TextUnformatted( line, line + view.byte_offset( 0 ) );
+                    for ( size_t j = 0; j < MemoryView::row_size; j++ ) {
+                        const char *byte = line + view.byte_offset( j );
+                        u32 age = view.byte_age( i * MemoryView::row_size + j );
+                        ImGui::SameLine();
+                        if ( age < change_fade_frames ) {
+                            f32 fade = static_cast<f32>( age ) / change_fade_frames;
+                            const ImVec4 &text_color = ImGui::GetStyle().Colors[ImGuiCol_Text];
+                            ImGui::PushStyleColor( ImGuiCol_Text,
+                                                   ImVec4( 1.0f + ( text_color.x - 1.0f ) * fade,
+                                                           0.5f + ( text_color.y - 0.5f ) * fade,
+                                                           text_color.z * fade, text_color.w ) );
+                            ImGui::TextUnformatted( byte, byte + 3 );
+                            ImGui::PopStyleColor();
+                        } else {
+                            ImGui::TextUnformatted( byte, byte + 3 );
+                        }
+                    }
+                    ImGui::SameLine();
+                    ImGui::TextUnformatted( line + view.byte_offset( MemoryView::row_size ) );
                 }
             }
             ImGui::PopStyleVar();
-        }
-        ImGui::End();
+            ImGui::End();
+        };
+        draw_memory_view( "Text (ROM)", text_view );
+        draw_memory_view( "External RAM", xram_view );
+        draw_memory_view( "Internal RAM", iram_view );
 
-        ImGui::Begin( "External RAM" );
+        ImGui::Begin( "Assembly" );
         {
             ImGui::PushStyleVar( ImGuiStyleVar_ItemSpacing, ImVec2( 0, 0 ) );
             ImGuiListClipper clipper;
-            clipper.Begin( processor->xram.size() / 8 );
+            clipper.Begin( listing_rows.size() );
             while ( clipper.Step() ) {
                 for ( size_t i = clipper.DisplayStart; i < clipper.DisplayEnd; i++ ) {
-                    String line = "Addr " + to_hex_str( i * 8 ) + ": ";
-                    String ascii = "  |  ";
-                    for ( size_t j = 0; j < 8; j++ ) {
-                        u8 byte = processor->xram[i * 8 + j];
-                        line += " " + to_hex_str( byte );
-                        ascii +=
-                            ( to_human_readable_ascii( byte ) == '%' ? String( "%%" )
-                                                                     : String( 1, to_human_readable_ascii( byte ) ) );
+                    u16 code_index = listing_rows[i];
+                    auto &row = disassembly_rows[i];
+                    if ( row.text.empty() ) {
+                        row = listed_instructions.test( code_index )
+                                  ? decode_disassembly_row( *processor, code_index )
+                                  : decode_data_row( *processor, code_index, code_map.row_size( code_index ) );
+                    }
+                    update_disassembly_row( row, *processor );
+                    bool has_bp = processor->breakpoints.code_execute.test( code_index );
+                    ImGui::PushID( i );
+                    if ( ImGui::Button( has_bp ? "O" : " " ) ) {
+                        simulation->execute( [=]( Processor &processor ) {
+                            processor.breakpoints.set( MemSpace::code, Breakpoints::execute, code_index, !has_bp );
+                        } );
                     }
-                    line += ascii;
-                    ImGui::Text( line.c_str() );
+                    ImGui::SameLine();
+                    if ( code_index == processor->pc ) {
+                        ImGui::TextColored( ImVec4( 1.0f, 1.0f, 0.0f, 1.0f ), " %02x: %s", code_index,
+                                            row.text.c_str() );
+                        if ( last_pc != processor->pc ) {
+                            ImGui::SetScrollHereY();
+                            last_pc = processor->pc;
+                        }
+                    } else {
+                        ImGui::Text( " %02x: %s", code_index, row.text.c_str() );
+                    }
+                    if ( ImGui::BeginPopupContextItem( "line_context" ) ) {
+                        if ( ImGui::MenuItem( "Run to cursor" ) )
+                            start_step( [=]( Processor &processor ) { processor.run_to( code_index ); } );
+                        ImGui::EndPopup();
+                    }
+                    auto symbol = processor->symbols.find( code_index );
+                    if ( symbol != processor->symbols.end() ) {
+                        ImGui::SameLine();
+                        ImGui::TextDisabled( "  ; %s", symbol->second.c_str() );
+                    }
+                    ImGui::PopID();
                 }
             }
             ImGui::PopStyleVar();
         }
         ImGui::End();
 
-        ImGui::Begin( "Internal RAM" );
+        ImGui::Begin( "Breakpoints" );
         {
-            ImGui::PushStyleVar( ImGuiStyleVar_ItemSpacing, ImVec2( 0, 0 ) );
-            ImGuiListClipper clipper;
-            clipper.Begin( processor->iram.size() / 8 );
-            while ( clipper.Step() ) {
-                for ( size_t i = clipper.DisplayStart; i < clipper.DisplayEnd; i++ ) {
-                    String line = "Addr " + to_hex_str( i * 8 ) + ": ";
-                    String ascii = "  |  ";
-                    for ( size_t j = 0; j < 8; j++ ) {
-                        u8 byte = processor->iram[i * 8 + j];
-                        line += " " + to_hex_str( byte );
-                        ascii +=
-                            ( to_human_readable_ascii( byte ) == '%' ? String( "%%" )
-                                                                     : String( 1, to_human_readable_ascii( byte ) ) );
-                    }
-                    line += ascii;
-                    ImGui::Text( line.c_str() );
+            const char *space_names[] = { "Code", "IRAM", "SFR", "XRAM" };
+            ImGui::Combo( "Space", &watch_space, space_names, 4 );
+            ImGui::InputText( "Address", &watch_addr_str );
+            ImGui::Checkbox( "Read", &watch_read );
+            ImGui::SameLine();
+            ImGui::Checkbox( "Write", &watch_write );
+            if ( ImGui::Button( "Add watchpoint" ) ) {
+                if ( watch_addr_str.empty() || watch_addr_str.size() > 4 ||
+                     watch_addr_str.find_first_not_of( "0123456789abcdefABCDEF" ) != watch_addr_str.npos ) {
+                    log( "Invalid watchpoint address" );
+                } else {
+                    u16 addr = stoi( watch_addr_str, 0, 16 );
+                    auto space = static_cast<MemSpace>( watch_space );
+                    simulation->execute( [=, read = watch_read, write = watch_write]( Processor &processor ) {
+                        if ( ( read && !processor.breakpoints.set( space, Breakpoints::read, addr, true ) ) ||
+                             ( write && !processor.breakpoints.set( space, Breakpoints::write, addr, true ) ) )
+                            log( "Watchpoint kind not supported for this address space" );
+                    } );
                 }
             }
-            ImGui::PopStyleVar();
+            ImGui::InputText( "Condition", &break_condition_str );
+            ImGui::InputInt( "Ignore hits", &break_ignore_count );
+            if ( ImGui::Button( "Add breakpoint" ) ) {
+                if ( watch_space != static_cast<int>( MemSpace::code ) || watch_addr_str.empty() ||
+                     watch_addr_str.size() > 4 ||
+                     watch_addr_str.find_first_not_of( "0123456789abcdefABCDEF" ) != watch_addr_str.npos ) {
+                    log( "Invalid breakpoint address (must be in code space)" );
+                } else {
+                    u16 addr = stoi( watch_addr_str, 0, 16 );
+                    size_t ignore_count = std::max( break_ignore_count, 0 );
+                    simulation->execute( [=, condition = break_condition_str]( Processor &processor ) {
+                        processor.breakpoints.set_conditional( addr, condition, ignore_count );
+                    } );
+                }
+            }
+            ImGui::SameLine();
+            if ( ImGui::Button( "Remove all" ) ) {
+                simulation->execute( []( Processor &processor ) { processor.breakpoints.clear(); } );
+            }
+
+            ImGui::Separator();
+            std::vector<std::tuple<MemSpace, Breakpoints::Kind, u16>> to_remove;
+            int id = 0;
+            processor->breakpoints.for_each( [&]( MemSpace space, Breakpoints::Kind kind, u16 addr ) {
+                ImGui::PushID( id++ );
+                if ( ImGui::SmallButton( "X" ) )
+                    to_remove.emplace_back( space, kind, addr );
+                ImGui::PopID();
+                ImGui::SameLine();
+                String kind_name = kind == Breakpoints::execute ? "execute"
+                                   : kind == Breakpoints::read  ? "read"
+                                                                : "write";
+                String text = kind_name + " " + mem_space_name( space ) + " " + to_hex_str( addr, 16 );
+                auto opts = processor->breakpoints.options.find( addr );
+                if ( kind == Breakpoints::execute && opts != processor->breakpoints.options.end() ) {
+                    if ( !opts->second.expression.empty() )
+                        text += " if " + opts->second.expression;
+                    if ( opts->second.ignore_count > 0 )
+                        text += " (ignore " + to_string( opts->second.ignore_count ) + ")";
+                    text += " hits: " + to_string( opts->second.hit_count );
+                }
+                ImGui::Text( text.c_str() );
+            } );
+            for ( auto &bp : to_remove ) {
+                simulation->execute( [=]( Processor &processor ) {
+                    processor.breakpoints.set( std::get<0>( bp ), std::get<1>( bp ), std::get<2>( bp ), false );
+                } );
+            }
         }
         ImGui::End();
 
-        ImGui::Begin( "Assembly" );
+        ImGui::Begin( "Anomalies" );
         {
-            ImGui::PushStyleVar( ImGuiStyleVar_ItemSpacing, ImVec2( 0, 0 ) );
-            ImGuiListClipper clipper;
-            clipper.Begin( op_code_indices.size() );
-            while ( clipper.Step() ) {
-                for ( size_t i = clipper.DisplayStart; i < clipper.DisplayEnd; i++ ) {
-                    u16 code_index = op_code_indices[i];
-                    String line = " " + to_hex_str( code_index ) + ": " +
-                                  get_decoded_instruction_string( *processor, code_index );
-                    auto bp_itr =
-                        std::find( processor->break_addresses.begin(), processor->break_addresses.end(), code_index );
-                    ImGui::PushID( i );
-                    if ( bp_itr != processor->break_addresses.end() ) {
-                        if ( ImGui::Button( "O" ) ) {
-                            processor->break_addresses.erase( bp_itr );
-                        }
-                    } else {
-                        if ( ImGui::Button( " " ) ) {
-                            processor->break_addresses.push_back( code_index );
-                        }
-                    }
-                    ImGui::PopID();
-                    ImGui::SameLine();
-                    if ( code_index == processor->pc ) {
-                        ImGui::TextColored( ImVec4( 1.0f, 1.0f, 0.0f, 1.0f ), line.c_str() );
-                        if ( last_pc != processor->pc ) {
-                            ImGui::SetScrollHereY();
-                            last_pc = processor->pc;
-                        }
-                    } else {
-                        ImGui::Text( line.c_str() );
-                    }
+            String total = "Total: " + to_string( processor->anomalies.total() ) + " (since the last full reset)";
+            ImGui::Text( total.c_str() );
+            ImGui::SameLine();
+            if ( ImGui::SmallButton( "Clear" ) ) {
+                simulation->execute( []( Processor &processor ) { processor.anomalies.clear(); } );
+            }
+            ImGui::Separator();
+            for ( size_t i = 0; i < processor->anomalies.counters.size(); i++ ) {
+                auto &counter = processor->anomalies.counters[i];
+                String text = String( anomaly_name( static_cast<Anomaly>( i ) ) ) + ": " + to_string( counter.count );
+                if ( counter.count > 0 ) {
+                    text += " (first at " + to_hex_str( counter.first_pc, 16 ) + ", cycle " +
+                            to_string( counter.first_cycle ) + "; last at " + to_hex_str( counter.last_pc, 16 ) +
+                            ", cycle " + to_string( counter.last_cycle ) + ")";
+                    ImGui::TextColored( ImVec4( 1.0f, 0.8f, 0.3f, 1.0f ), text.c_str() );
+                } else {
+                    ImGui::Text( text.c_str() );
                 }
             }
-            ImGui::PopStyleVar();
+        }
+        ImGui::End();
+
+        ImGui::Begin( "Statistics" );
+        {
+            auto &stats = processor->stats;
+            u64 cycles = processor->cycle_count - stats.start_cycle;
+            ImGui::Text(
+                String( "Instructions: " + to_string( stats.instructions() ) + ", cycles: " + to_string( cycles ) )
+                    .c_str() );
+            ImGui::Text( String( "Host time: " + to_string( stats.host_seconds ) + " s (" +
+                                 to_string( stats.host_seconds > 0 ? cycles / stats.host_seconds / 1e6 : 0 ) +
+                                 " M cycles/s)" )
+                             .c_str() );
+            ImGui::Text( String( "Idle cycles: " + to_string( stats.idle_cycles ) +
+                                 ", power down steps: " + to_string( stats.power_down_steps ) )
+                             .c_str() );
+            ImGui::Text( String( "MOVX reads: " + to_string( stats.movx_reads ) +
+                                 ", writes: " + to_string( stats.movx_writes ) )
+                             .c_str() );
+            ImGui::Text( String( "Timer overflows: " + to_string( stats.timer_overflows[0] ) + " (T0), " +
+                                 to_string( stats.timer_overflows[1] ) + " (T1)" )
+                             .c_str() );
+            String interrupts = "Interrupts:";
+            for ( size_t i = 0; i < stats.interrupts.size(); i++ )
+                interrupts += String( " " ) + RuntimeStats::interrupt_names[i] + "=" + to_string( stats.interrupts[i] );
+            ImGui::Text( interrupts.c_str() );
+            ImGui::InputText( "Statistics file", &stats_filename );
+            if ( ImGui::Button( "Export JSON" ) ) {
+                std::ofstream output( stats_filename );
+                stats.write_json( output, processor->cycle_count );
+                output << '\n';
+                if ( output.good() )
+                    log( "Exported statistics" );
+                else
+                    log( LogLevel::error, "Failed to write '" + stats_filename + "'" );
+            }
+            ImGui::SameLine();
+            if ( ImGui::Button( "Clear statistics" ) ) {
+                simulation->execute( []( Processor &processor ) { processor.stats.clear( processor.cycle_count ); } );
+            }
+
+            // Most executed op codes first
+            ImGui::Separator();
+            std::vector<u8> opcodes;
+            for ( size_t op = 0; op < stats.opcodes.size(); op++ ) {
+                if ( stats.opcodes[op] > 0 )
+                    opcodes.push_back( op );
+            }
+            std::sort( opcodes.begin(), opcodes.end(),
+                       [&]( u8 x, u8 y ) { return stats.opcodes[x] > stats.opcodes[y]; } );
+            f64 executed = std::max<u64>( stats.instructions(), 1 );
+            for ( u8 op : opcodes ) {
+                ImGui::Text( "%02x %-6s %12llu  %5.1f%%", op, mnemonic_name( instruction_set[op].mnemonic ),
+                             static_cast<unsigned long long>( stats.opcodes[op] ), 100 * stats.opcodes[op] / executed );
+            }
         }
         ImGui::End();
 
@@ -386,6 +643,7 @@ int main() {
         {
             should_load |= ImGui::InputText( "In file", &editor_asm_filename, ImGuiInputTextFlags_EnterReturnsTrue );
             ImGui::InputText( "Out directory", &editor_hex_file_dir );
+            ImGui::Checkbox( "Write hex file", &editor_write_hex );
 
             should_load |= ImGui::Button( "Load" );
             ImGui::SameLine();
@@ -417,23 +675,38 @@ int main() {
             }
 
             if ( should_compile ) {
-                auto name_begin = editor_asm_filename.find_last_of( "/" ) + 1;
-                if ( name_begin == editor_asm_filename.npos + 1 )
-                    name_begin = 0;
-                auto name_size = editor_asm_filename.find_last_of( "." ) - name_begin;
-                auto filename =
-                    editor_hex_file_dir + "/" + editor_asm_filename.substr( name_begin, name_size ) + ".hex";
-                std::ofstream file( filename );
-
-                compile_assembly( editor_content, file );
-                file.close();
+                bool assembled = editor_assembler.assemble( editor_content );
+                if ( assembled ) {
+                    log( "Compilation successful." );
+                    if ( editor_write_hex ) {
+                        auto name_begin = editor_asm_filename.find_last_of( "/" ) + 1;
+                        if ( name_begin == editor_asm_filename.npos + 1 )
+                            name_begin = 0;
+                        auto name_size = editor_asm_filename.find_last_of( "." ) - name_begin;
+                        auto filename =
+                            editor_hex_file_dir + "/" + editor_asm_filename.substr( name_begin, name_size ) + ".hex";
+                        std::ofstream file( filename );
+                        encode_hex_file( editor_assembler.code, file );
+                    }
+                }
 
-                if ( hex_filename == filename ) {
-                    steps_per_frame = 0;
-                    max_speed = false;
-                    use_fix_target_frequency = false;
-                    if ( processor->load_hex_code( hex_filename ) )
-                        decode_instructions( *processor, op_code_indices );
+                // The program is loaded directly (without hex file). Once it runs, only changed bytes are written into
+                // it (removed code is cleared) and the Assembly window decodes only this range again.
+                if ( !assembled ) {
+                    editor_program_loaded = false; // The next changes are relative to code which isn't loaded.
+                } else if ( !editor_program_loaded ) {
+                    simulation->load( editor_assembler.code, editor_assembler.symbols() );
+                    editor_program_loaded = true;
+                } else {
+                    auto &code = editor_assembler.code;
+                    size_t first = std::min( editor_assembler.changed.first, decltype( Processor::text )::size() );
+                    size_t last = std::min( editor_assembler.changed.second, decltype( Processor::text )::size() );
+                    std::vector<u8> bytes( code.begin() + std::min( first, code.size() ),
+                                           code.begin() + std::min( last, code.size() ) );
+                    bytes.resize( last - first );
+                    if ( !bytes.empty() )
+                        log( "Patched " + to_string( bytes.size() ) + " bytes of code" );
+                    simulation->patch( first, std::move( bytes ), editor_assembler.symbols() );
                 }
                 should_compile = false;
             }
@@ -448,7 +721,7 @@ int main() {
             while ( clipper.Step() ) {
                 for ( size_t i = clipper.DisplayStart; i < clipper.DisplayEnd; i++ ) {
                     String line =
-                        global_log[i] + ( i == global_log.size() - 1
+                        global_log[i].text + ( i == global_log.size() - 1
                                               ? " (" +
                                                     to_string( static_cast<size_t>(
                                                         last_global_log_timer.getElapsedTime().asSeconds() ) ) +
@@ -457,20 +730,25 @@ int main() {
                     if ( last_global_log_timer.getElapsedTime().asSeconds() < 10.f && i == global_log.size() - 1 ) {
                         if ( to_lower( line ).find( "success" ) != line.npos ) {
                             ImGui::TextColored( ImVec4( 0.0f, 1.0f, 0.0f, 1.0f ), line.c_str() );
-                        } else if ( to_lower( line ).find( "fail" ) != line.npos ) {
+                        } else if ( to_lower( line ).find( "fail" ) != line.npos ||
+                                    global_log[i].level == LogLevel::error ) {
                             ImGui::TextColored( ImVec4( 1.0f, 0.0f, 0.0f, 1.0f ), line.c_str() );
                         } else {
                             ImGui::Text( line.c_str() );
                         }
+                    } else if ( global_log[i].level == LogLevel::error ) {
+                        ImGui::TextColored( ImVec4( 1.0f, 0.4f, 0.4f, 1.0f ), line.c_str() );
+                    } else if ( global_log[i].level == LogLevel::warning ) {
+                        ImGui::TextColored( ImVec4( 1.0f, 0.8f, 0.3f, 1.0f ), line.c_str() );
                     } else {
                         ImGui::Text( line.c_str() );
                     }
                 }
             }
             ImGui::PopStyleVar();
-            if ( last_log_size != global_log.size() ) {
+            if ( last_log_count != global_log_count ) {
                 ImGui::SetScrollHereY();
-                last_log_size = global_log.size();
+                last_log_count = global_log_count;
             }
         }
         ImGui::End();
@@ -482,11 +760,63 @@ int main() {
         }
         ImGui::End();
 
+        ImGui::Begin( "Profiler" );
+        if ( !Profiler::enabled ) {
+            ImGui::TextWrapped( "The profiling zones are only compiled into debug builds (see SIM8051_PROFILING)." );
+        } else {
+            bool active = profiler.is_active();
+            if ( ImGui::Checkbox( "Active", &active ) )
+                profiler.set_active( active );
+            // Rates of the last second
+            if ( profile_clock.getElapsedTime().asSeconds() >= 1.f ) {
+                profile_seconds = profile_clock.restart().asSeconds();
+                for ( size_t i = 0; i < zone_count; i++ ) {
+                    auto totals = profiler.totals( static_cast<Zone>( i ) );
+                    profile_interval[i] = { totals.calls - profile_last[i].calls,
+                                            totals.ticks - profile_last[i].ticks, totals.max_ticks };
+                    profile_last[i] = totals;
+                }
+            }
+            f64 ticks_per_second = profiler.ticks_per_second();
+            ImGui::Text( "%-14s %12s %10s %7s %10s", "Zone", "Calls/s", "Avg ns", "Load", "Max us" );
+            ImGui::Separator();
+            for ( size_t i = 0; i < zone_count; i++ ) {
+                auto &totals = profile_interval[i];
+                f64 seconds = totals.ticks / ticks_per_second;
+                ImGui::Text( "%-14s %12.0f %10.1f %6.1f%% %10.1f", zone_name( static_cast<Zone>( i ) ),
+                             totals.calls / profile_seconds, totals.calls > 0 ? 1e9 * seconds / totals.calls : 0.0,
+                             100 * seconds / profile_seconds, 1e6 * totals.max_ticks / ticks_per_second );
+            }
+            ImGui::TextDisabled( "Load is the share of one thread's time (frame_render includes waiting for vsync)." );
+            if ( ImGui::Button( "Reset maximums" ) ) {
+                profiler.reset();
+                profile_last = {};
+            }
+
+            ImGui::Separator();
+            ImGui::InputText( "Trace file", &trace_filename );
+            if ( !profiler.is_tracing() ) {
+                if ( ImGui::Button( "Start trace" ) )
+                    profiler.start_trace();
+            } else {
+                ImGui::Text( "Recorded %zu of %zu calls", profiler.trace_size(), Profiler::trace_capacity );
+                if ( ImGui::Button( "Stop and export" ) ) {
+                    std::ofstream output( trace_filename );
+                    if ( profiler.write_trace( output ) && output.good() )
+                        log( "Exported trace to '" + trace_filename + "' (open it with chrome://tracing or Perfetto)" );
+                    else
+                        log( LogLevel::error, "Failed to write trace '" + trace_filename + "'" );
+                }
+            }
+        }
+        ImGui::End();
+
         // ImGui::ShowDemoWindow();
 
         ImGui::EndFrame();
 
         // Rendering
+        phase_zone.next( Zone::frame_render );
 
         window.clear( sf::Color( 0x707070ff ) );
 
@@ -503,8 +833,3 @@ int main() {
     return 0;
 }
 
-void log( const String &str ) {
-    std::cout << str << std::endl;
-    global_log.push_back( str );
-    last_global_log_timer.restart();
-}